@@ -0,0 +1,163 @@
+// =================================================================================================================================
+/**
+ * \file   bench-suite.c
+ * \brief  Run one standard workload over a simulated data set, and report its speed and paging activity as a line of CSV.
+ *
+ * The real memory size is taken by the library from `VMSIM_REAL_MEM_SIZE`, so the `bench` target of the Makefile runs this program
+ * once per cell of its workload-by-memory-size matrix.  The workloads come from the `workload` library with their default
+ * parameters and seed, so runs are reproducible.
+ **/
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// INCLUDES
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vmsim.h"
+#include "workload.h"
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// CONSTANTS AND MACRO FUNCTIONS
+
+/** The default number of bytes in the simulated data set. */
+#define DEFAULT_DATA_SIZE  (32 * 1024 * 1024)
+
+/** The default number of accesses to make. */
+#define DEFAULT_ACCESSES   1000000
+
+/** The smallest data set allowed. */
+#define MIN_DATA_SIZE      4096
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief Display the proper usage and end the process with an error code.
+ * \param invocation The command-line text given to run the executable.
+ */
+void
+show_usage_and_exit (char* invocation) {
+
+  fprintf(stderr, "USAGE: %s --header\n", invocation);
+  fprintf(stderr, "       %s <workload> [<data size (bytes)> <accesses per thread> [<threads>]]\n", invocation);
+  fprintf(stderr, "WORKLOADS:");
+  for (workload_kind_t kind = WORKLOAD_SEQUENTIAL; kind <= WORKLOAD_POINTER_CHASE; kind += 1) {
+    fprintf(stderr, " %s", workload_kind_name(kind));
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+
+} // show_usage_and_exit ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief Run a workload and print its results.
+ * \param kind      The kind of workload to run.
+ * \param data_size The number of bytes in the simulated data set.
+ * \param accesses  The number of accesses to make in each thread.
+ * \param threads   The number of threads to run.
+ */
+void
+go (workload_kind_t kind, uint64_t data_size, uint64_t accesses, unsigned int threads) {
+
+  workload_spec_t spec;
+  workload_default_spec(&spec, kind, data_size);
+
+  // Allocate the data set, and count only the activity of the workload itself.
+  vmsim_addr_t base = vmsim_alloc(data_size);
+  assert(base != 0);
+  vmsim_reset_stats();
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  uint64_t checksum = workload_drive(&spec, base, accesses, threads);
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  vmsim_stats_t stats;
+  vmsim_get_stats(&stats);
+  double elapsed_ns = ((end.tv_sec - start.tv_sec) * 1e9) + (end.tv_nsec - start.tv_nsec);
+
+  // Report the real memory size as the library sees it.
+  char* real_size = getenv("VMSIM_REAL_MEM_SIZE");
+  printf("%s,%s,%lu,%u,%lu,%.2f,%lu,%lu,%lu,%lu,%.3f,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+         workload_kind_name(kind), real_size != NULL ? real_size : "default", data_size, threads, accesses * threads,
+         elapsed_ns / (accesses * threads), stats.faults, stats.evictions, stats.bs_reads, stats.bs_writes, stats.sim_time / 1e6,
+         stats.bs_fast_reads, stats.promotions, stats.demotions, stats.local_accesses, stats.remote_accesses, stats.migrations,
+         stats.thrash_episodes, stats.thrash_accesses);
+
+  // Keep the loads from being optimized away.
+  if (checksum == 1) {
+    fprintf(stderr, "\n");
+  }
+
+  vmsim_free(base);
+
+} // go ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief The entry point to the benchmark.
+ * \param argc The length of the command-line argument vector.
+ * \param argv The vector of command-line arguments.
+ * \return the exit code for the process, where 0 indicates success, any other value indicates error.
+ */
+int
+main (int argc, char** argv) {
+
+  // Check usage.
+  if (argc == 2 && strcmp(argv[1], "--header") == 0) {
+    printf("workload,real_mem_size,data_size,threads,accesses,ns_per_access,faults,evictions,bs_reads,bs_writes,sim_ms,"
+           "bs_fast_reads,promotions,demotions,local_accesses,remote_accesses,migrations,thrash_episodes,thrash_accesses\n");
+    return 0;
+  }
+  if (argc != 2 && argc != 4 && argc != 5) {
+    show_usage_and_exit(argv[0]);
+  }
+
+  // Find the workload.
+  workload_kind_t kind;
+  if (!workload_parse_kind(argv[1], &kind)) {
+    show_usage_and_exit(argv[0]);
+  }
+
+  // Extract the optional arguments.
+  uint64_t     data_size = DEFAULT_DATA_SIZE;
+  uint64_t     accesses  = DEFAULT_ACCESSES;
+  unsigned int threads   = 1;
+  if (argc >= 4) {
+    errno = 0;
+    data_size = strtoull(argv[2], NULL, 10);
+    accesses  = strtoull(argv[3], NULL, 10);
+    if (argc == 5) {
+      threads = atoi(argv[4]);
+    }
+    if (errno != 0 || data_size < MIN_DATA_SIZE || accesses < 1 || threads < 1) {
+      show_usage_and_exit(argv[0]);
+    }
+  }
+
+  go(kind, data_size, accesses, threads);
+  return 0;
+
+} // main ()
+// =================================================================================================================================
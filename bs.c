@@ -15,8 +15,12 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <unistd.h>
 #include "bs.h"
+#include "geometry.h"
+#include "host.h"
 // =================================================================================================================================
 
 
@@ -24,23 +28,276 @@
 // =================================================================================================================================
 // CONSTANTS AND MACRO FUNCTIONS
 
-#define KB(n)      (n * 1024)
-#define MB(n)      (KB(n) * 1024)
-#define GB(n)      (MB(n) * 1024)
- 
 #define DEFAULT_BACKING_STORE_SIZE GB(1)
-#define BLOCK_SIZE                 KB(4)
+
+// The most operations that any device may service at once.
+#define MAX_QUEUE_DEPTH            256
+
+// The share of the blocks that the fast tier holds by default, as a divisor.
+#define DEFAULT_FAST_FRACTION      8
+
+// How many recent reads of a block promote it to the fast tier, and the percentage of the fast tier to which demotion empties it.
+#define PROMOTION_READS            2
+#define DEMOTION_LOW_WATER         90
 
 static void*        bs_base        = NULL;
 static void*        bs_limit       = NULL;
 static uint64_t     bs_size        = DEFAULT_BACKING_STORE_SIZE;
+static bool         bs_hugetlb     = false;
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// THE DEVICE MODEL
+
+// The parameters of a device.
+typedef struct {
+  const char*  name;
+  uint64_t     latency;      // Nanoseconds per operation.
+  uint64_t     bandwidth;    // MB per second, or 0 for unlimited.
+  unsigned int queue;        // Operations serviced at once.
+  uint64_t     seek;         // Further nanoseconds for an operation that is not sequential.
+  unsigned int stripes;      // Identical instances across which a tier's blocks are striped.
+} device_t;
+
+// The presets, roughly a RAM disk, compressed RAM, a datacenter NVMe drive, a SATA SSD, and a 7200 RPM disk.
+static const device_t presets[] = {
+  { "ram",  0,       0,    1,  0,       1 },
+  { "zram", 5000,    2000, 1,  0,       1 },
+  { "nvme", 20000,   3000, 64, 0,       1 },
+  { "ssd",  80000,   500,  32, 10000,   1 },
+  { "hdd",  4000000, 150,  1,  8000000, 1 }
+};
+
+// One instance of a device:  for each slot of its queue, the time at which it finishes its current operation, and the block of its
+// previous operation, to recognize sequential ones.
+typedef struct {
+  uint64_t     slot_busy_until[MAX_QUEUE_DEPTH];
+  unsigned int last_block;
+} instance_t;
+
+// A tier of the backing store:  its device, the instances of that device, and for the fast tier, how many blocks it holds.  The
+// device that holds mapped files is modeled in the same way, after the tiers.
+typedef struct {
+  device_t     device;
+  instance_t*  instances;
+  uint64_t     capacity;
+  uint64_t     used;
+} tier_t;
+
+#define SLOW_TIER   0
+#define FAST_TIER   1
+#define FILE_DEVICE 2
+
+static tier_t       tiers[3];
+static bool         tiered         = false;
+
+// For each block, the tier that holds it; how often it has been read back lately (halved whenever demotion passes it); and if it
+// is in the fast tier, its position in `fast_blocks`.
+static uint8_t*     block_tier     = NULL;
+static uint8_t*     block_reads    = NULL;
+static uint32_t*    block_position = NULL;
+
+// The blocks in the fast tier, and the hand of the demotion clock that goes around them.
+static unsigned int* fast_blocks   = NULL;
+static uint64_t      demotion_hand = 0;
+
+// The simulated clock, and the library's activity counts.
+static uint64_t*      clock_ns     = NULL;
+static vmsim_stats_t* stats        = NULL;
+
+// What a checkpoint records about the backing store, after its blocks:  the configuration that the blocks' placement depends upon,
+// and the scalar state of the tiers.  The instances of each tier's device, and for a tiered store, the placement of each block and
+// the fast tier's list, follow it.
+typedef struct {
+  uint64_t     num_blocks;
+  uint64_t     fast_capacity;
+  uint64_t     fast_used;
+  uint64_t     demotion_hand;
+  uint32_t     tiered;
+  uint32_t     stripes[2];
+} bs_checkpoint_t;
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+static void
+parse_device (char* spec, device_t* device) {
+
+  char* save = NULL;
+  char* name = strtok_r(spec, ",", &save);
+  bool  found = false;
+  for (unsigned int i = 0; i < sizeof(presets) / sizeof(presets[0]) && name != NULL; i += 1) {
+    if (strcmp(name, presets[i].name) == 0) {
+      *device = presets[i];
+      found   = true;
+    }
+  }
+  if (!found) {
+    fprintf(stderr, "ERROR:\tbs_init():\tUnknown device %s\n", name != NULL ? name : "");
+    abort();
+  }
+
+  for (char* option = strtok_r(NULL, ",", &save); option != NULL; option = strtok_r(NULL, ",", &save)) {
+    char* value = strchr(option, '=');
+    if (value == NULL) {
+      fprintf(stderr, "ERROR:\tbs_init():\tBad device option %s\n", option);
+      abort();
+    }
+    *value = '\0';
+    errno = 0;
+    uint64_t number = strtoull(value + 1, NULL, 10);
+    assert(errno == 0);
+    if (strcmp(option, "latency") == 0) {
+      device->latency = number;
+    } else if (strcmp(option, "bandwidth") == 0) {
+      device->bandwidth = number;
+    } else if (strcmp(option, "queue") == 0) {
+      device->queue = number;
+    } else if (strcmp(option, "seek") == 0) {
+      device->seek = number;
+    } else if (strcmp(option, "stripes") == 0) {
+      device->stripes = number;
+    } else {
+      fprintf(stderr, "ERROR:\tbs_init():\tBad device option %s\n", option);
+      abort();
+    }
+  }
+  assert(device->queue >= 1 && device->queue <= MAX_QUEUE_DEPTH);
+  assert(device->stripes >= 1);
+
+} // parse_device ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+static void
+init_tier (tier_t* tier, char* envvar, const device_t* default_device) {
+
+  tier->device = *default_device;
+  char* spec_envvar = getenv(envvar);
+  if (spec_envvar != NULL) {
+    char* spec = strdup(spec_envvar);
+    assert(spec != NULL);
+    parse_device(spec, &tier->device);
+    free(spec);
+  }
+  tier->instances = calloc(tier->device.stripes, sizeof(instance_t));
+  assert(tier->instances != NULL);
+
+} // init_tier ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+static uint64_t
+service (unsigned int tier_number, unsigned int block_number) {
+
+  // Blocks are striped across the tier's instances, and each instance sees its share as a contiguous run.
+  tier_t*      tier     = &tiers[tier_number];
+  instance_t*  instance = &tier->instances[block_number % tier->device.stripes];
+  unsigned int position = block_number / tier->device.stripes;
+
+  // The operation waits for the first slot of the queue to come free, and then takes the device's time for it.
+  unsigned int slot = 0;
+  for (unsigned int i = 1; i < tier->device.queue; i += 1) {
+    if (instance->slot_busy_until[i] < instance->slot_busy_until[slot]) {
+      slot = i;
+    }
+  }
+  uint64_t start = (instance->slot_busy_until[slot] > *clock_ns) ? instance->slot_busy_until[slot] : *clock_ns;
+  uint64_t time  = tier->device.latency;
+  if (tier->device.bandwidth > 0) {
+    time += (BLOCK_SIZE * 1000) / tier->device.bandwidth;
+  }
+  if (position != instance->last_block + 1) {
+    time += tier->device.seek;
+  }
+  instance->last_block = position;
+
+  instance->slot_busy_until[slot] = start + time;
+  return start + time;
+
+} // service ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+static void
+place_block (unsigned int block_number, unsigned int to_tier) {
+
+  // Update the fast tier's list of blocks.
+  if (to_tier == FAST_TIER) {
+    block_position[block_number] = tiers[FAST_TIER].used;
+    fast_blocks[tiers[FAST_TIER].used] = block_number;
+    tiers[FAST_TIER].used += 1;
+  } else {
+    uint64_t     position = block_position[block_number];
+    unsigned int last     = fast_blocks[tiers[FAST_TIER].used - 1];
+    fast_blocks[position]  = last;
+    block_position[last]   = position;
+    tiers[FAST_TIER].used -= 1;
+  }
+  block_tier[block_number] = to_tier;
+
+} // place_block ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+static void
+move_block (unsigned int block_number, unsigned int to_tier) {
+
+  // Copy the block between the tiers in the background.  A block is promoted just after it has been read, so only a demoted block
+  // must be read from its old tier before it can be written to its new one.
+  uint64_t now = *clock_ns;
+  if (to_tier == SLOW_TIER) {
+    *clock_ns = service(FAST_TIER, block_number);
+  }
+  service(to_tier, block_number);
+  *clock_ns = now;
+  place_block(block_number, to_tier);
+
+} // move_block ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+static void
+demote () {
+
+  // Go around the fast tier's blocks, halving their recent read counts, and demote those whose counts have decayed to zero until
+  // the tier is down to its low-water mark.  A count is at most 255, so eight trips around decay every count to zero, and the loop
+  // ends at the latest on the ninth, which demotes every block it reaches.
+  while (tiers[FAST_TIER].used > (tiers[FAST_TIER].capacity * DEMOTION_LOW_WATER) / 100) {
+    if (demotion_hand >= tiers[FAST_TIER].used) {
+      demotion_hand = 0;
+    }
+    unsigned int block_number = fast_blocks[demotion_hand];
+    if (block_reads[block_number] == 0) {
+      move_block(block_number, SLOW_TIER);
+      stats->demotions += 1;
+    } else {
+      block_reads[block_number] /= 2;
+      demotion_hand += 1;
+    }
+  }
+
+} // demote ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
 void
-bs_init () {
+bs_init (uint64_t* clock, vmsim_stats_t* stats_out) {
 
   // Only initialize if it hasn't already happened.
   if (bs_base == NULL) {
@@ -52,10 +309,33 @@ bs_init () {
       bs_size = strtoul(bs_size_envvar, NULL, 10);
       assert(errno == 0);
     }
+    uint64_t num_blocks = bs_size / BLOCK_SIZE;
+
+    // Determine the devices' timing, and set up the fast tier if there is one.
+    init_tier(&tiers[SLOW_TIER], "VMSIM_BS_DEVICE", &presets[0]);
+    if (getenv("VMSIM_BS_FAST_DEVICE") != NULL) {
+      tiered = true;
+      init_tier(&tiers[FAST_TIER], "VMSIM_BS_FAST_DEVICE", &presets[0]);
+      tiers[FAST_TIER].capacity = num_blocks / DEFAULT_FAST_FRACTION;
+      char* fast_blocks_envvar = getenv("VMSIM_BS_FAST_BLOCKS");
+      if (fast_blocks_envvar != NULL) {
+        errno = 0;
+        tiers[FAST_TIER].capacity = strtoull(fast_blocks_envvar, NULL, 10);
+        assert(errno == 0);
+      }
+      assert(tiers[FAST_TIER].capacity >= 1 && tiers[FAST_TIER].capacity <= num_blocks);
+      block_tier     = calloc(num_blocks, sizeof(uint8_t));
+      block_reads    = calloc(num_blocks, sizeof(uint8_t));
+      block_position = calloc(num_blocks, sizeof(uint32_t));
+      fast_blocks    = calloc(tiers[FAST_TIER].capacity, sizeof(unsigned int));
+      assert(block_tier != NULL && block_reads != NULL && block_position != NULL && fast_blocks != NULL);
+    }
+    init_tier(&tiers[FILE_DEVICE], "VMSIM_FILE_DEVICE", &tiers[SLOW_TIER].device);
+    clock_ns = clock;
+    stats    = stats_out;
 
-    // Map the backing store space.
-    bs_base = mmap(NULL, bs_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    assert(bs_base != NULL);
+    // Map the backing store space, backed as `VMSIM_HOST_PAGES` asks.
+    bs_base = host_map(bs_size, &bs_hugetlb);
     bs_limit = (void*)((intptr_t)bs_base + bs_size);
 		   
   }
@@ -90,8 +370,28 @@ bs_read (vmsim_addr_t buffer, unsigned int block_number) {
     return false;
   }
 
-  // Copy the block into real memory.
+  // Copy the block into real memory, and wait for the device of the tier that holds it.
   vmsim_write_real(block_ptr, buffer, BLOCK_SIZE);
+  if (!tiered) {
+    *clock_ns = service(SLOW_TIER, block_number);
+    return true;
+  }
+  *clock_ns = service(block_tier[block_number], block_number);
+  if (block_tier[block_number] == FAST_TIER) {
+    stats->bs_fast_reads += 1;
+  }
+
+  // A block that keeps being read back is promoted to the fast tier, making room there if need be.
+  if (block_reads[block_number] < UINT8_MAX) {
+    block_reads[block_number] += 1;
+  }
+  if (block_tier[block_number] == SLOW_TIER && block_reads[block_number] >= PROMOTION_READS) {
+    if (tiers[FAST_TIER].used == tiers[FAST_TIER].capacity) {
+      demote();
+    }
+    move_block(block_number, FAST_TIER);
+    stats->promotions += 1;
+  }
   return true;
   
 } // bs_read ()
@@ -107,9 +407,152 @@ bs_write (vmsim_addr_t buffer, unsigned int block_number) {
     return false;
   }
 
-  // Copy the block into real memory.
+  // Copy the block out of real memory, and leave the device of the tier that holds it to finish in the background.
   vmsim_read_real(block_ptr, buffer, BLOCK_SIZE);
+  service(tiered ? block_tier[block_number] : SLOW_TIER, block_number);
   return true;
   
 } // bs_write ()
 // =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void
+bs_release (unsigned int block_number) {
+
+  // The block's contents are dead, so it leaves the fast tier without being copied, and the page that reuses it starts with no
+  // history of reads.
+  if (!tiered) {
+    return;
+  }
+  block_reads[block_number] = 0;
+  if (block_tier[block_number] == FAST_TIER) {
+    place_block(block_number, SLOW_TIER);
+  }
+
+} // bs_release ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+bool
+bs_file_read (vmsim_addr_t buffer, int fd, uint64_t offset, size_t size) {
+
+  // Read what the file holds of the page, zero-filling the rest, and wait for the device.  The page's position in the file stands
+  // in for a block number, so that a scan of the file is sequential.
+  static uint8_t page[BLOCK_SIZE];
+  memset(page, 0, BLOCK_SIZE);
+  if (pread(fd, page, size, offset) < 0) {
+    return false;
+  }
+  vmsim_write_real(page, buffer, BLOCK_SIZE);
+  *clock_ns = service(FILE_DEVICE, offset / BLOCK_SIZE);
+  return true;
+
+} // bs_file_read ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+bool
+bs_file_write (vmsim_addr_t buffer, int fd, uint64_t offset, size_t size) {
+
+  // Write the part of the page that the file holds, and leave the device to finish in the background.
+  static uint8_t page[BLOCK_SIZE];
+  vmsim_read_real(page, buffer, size);
+  if (pwrite(fd, page, size, offset) != (ssize_t) size) {
+    return false;
+  }
+  service(FILE_DEVICE, offset / BLOCK_SIZE);
+  return true;
+
+} // bs_file_write ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+bool
+bs_checkpoint (FILE* file, unsigned int num_blocks) {
+
+  // The blocks come first, so that they start at a multiple of the page size and can be mapped back in place.
+  fwrite(bs_base, BLOCK_SIZE, num_blocks, file);
+
+  bs_checkpoint_t record = { 0 };
+  record.num_blocks    = bs_size / BLOCK_SIZE;
+  record.tiered        = tiered;
+  record.stripes[0]    = tiers[SLOW_TIER].device.stripes;
+  if (tiered) {
+    record.fast_capacity = tiers[FAST_TIER].capacity;
+    record.fast_used     = tiers[FAST_TIER].used;
+    record.demotion_hand = demotion_hand;
+    record.stripes[1]    = tiers[FAST_TIER].device.stripes;
+  }
+  fwrite(&record, sizeof(record), 1, file);
+  for (unsigned int tier = 0; tier <= (tiered ? FAST_TIER : SLOW_TIER); tier += 1) {
+    fwrite(tiers[tier].instances, sizeof(instance_t), tiers[tier].device.stripes, file);
+  }
+  if (tiered) {
+    fwrite(block_tier, sizeof(uint8_t), num_blocks, file);
+    fwrite(block_reads, sizeof(uint8_t), num_blocks, file);
+    fwrite(block_position, sizeof(uint32_t), num_blocks, file);
+    fwrite(fast_blocks, sizeof(unsigned int), tiers[FAST_TIER].used, file);
+  }
+  return !ferror(file);
+
+} // bs_checkpoint ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+bool
+bs_restore (FILE* file, unsigned int num_blocks) {
+
+  // Read the record that follows the blocks, and check that the blocks would be placed as they were, over memory that they can be
+  // mapped over.
+  long            blocks_offset = ftell(file);
+  bs_checkpoint_t record;
+  fseek(file, blocks_offset + ((long) num_blocks * BLOCK_SIZE), SEEK_SET);
+  if (bs_hugetlb || fread(&record, sizeof(record), 1, file) != 1 || record.num_blocks != bs_size / BLOCK_SIZE ||
+      record.tiered != tiered || (tiered && record.fast_capacity != tiers[FAST_TIER].capacity)) {
+    return false;
+  }
+
+  // Map the blocks from the file in place of the old ones, so that each is read only when it is first touched, and is copied only
+  // when it is first written.
+  void* blocks = mmap(bs_base, (size_t) num_blocks * BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fileno(file),
+                      blocks_offset);
+  assert(blocks == bs_base);
+
+  // Restore each tier's device, unless it is now striped differently, in which case it starts out idle.
+  bool read = true;
+  for (unsigned int tier = 0; tier <= (tiered ? FAST_TIER : SLOW_TIER); tier += 1) {
+    if (record.stripes[tier] == tiers[tier].device.stripes) {
+      read = read && fread(tiers[tier].instances, sizeof(instance_t), record.stripes[tier], file) == record.stripes[tier];
+    } else {
+      memset(tiers[tier].instances, 0, tiers[tier].device.stripes * sizeof(instance_t));
+      fseek(file, record.stripes[tier] * sizeof(instance_t), SEEK_CUR);
+    }
+  }
+
+  // Restore the placement of the blocks among the tiers.
+  if (tiered) {
+    read = read && fread(block_tier, sizeof(uint8_t), num_blocks, file) == num_blocks;
+    read = read && fread(block_reads, sizeof(uint8_t), num_blocks, file) == num_blocks;
+    read = read && fread(block_position, sizeof(uint32_t), num_blocks, file) == num_blocks;
+    read = read && fread(fast_blocks, sizeof(unsigned int), record.fast_used, file) == record.fast_used;
+    tiers[FAST_TIER].used = record.fast_used;
+    demotion_hand         = record.demotion_hand;
+  }
+  if (!read) {
+    fprintf(stderr, "ERROR:\tbs_restore():\tTruncated checkpoint\n");
+    abort();
+  }
+  return true;
+
+} // bs_restore ()
+// =================================================================================================================================
@@ -4,6 +4,30 @@
  * \brief  The interface for the backing store device.
  * \author Prof. Scott F. Kaplan
  * \date   Fall 2018
+ *
+ * The device keeps each block in memory, but charges each operation the time that a real swap device would take to perform it, on
+ * the library's simulated clock.  The device is described by the `VMSIM_BS_DEVICE` environment variable:  a preset, `ram` (the
+ * default, whose operations take no time), `zram`, `nvme`, `ssd` or `hdd`, optionally followed by comma-separated overrides of its
+ * parameters, as in `ssd,queue=4,latency=50000`:
+ *
+ * - `latency`:    the fixed cost of each operation, in nanoseconds.
+ * - `bandwidth`:  the transfer rate, in MB per second (0 for unlimited).
+ * - `queue`:      the number of operations that the device services at once.
+ * - `seek`:       the further cost of an operation on a block that does not follow the previous operation's block, in nanoseconds.
+ * - `stripes`:    the number of identical instances of the device, across which blocks are striped, block by block.
+ *
+ * A read is synchronous:  the clock advances to its completion, waiting first for a free slot in the queue.  A write is issued
+ * behind the clock's back, occupying a slot in the queue until it completes, so it delays only the reads that queue up behind it.
+ *
+ * Setting `VMSIM_BS_FAST_DEVICE` as well, to `zram` or `nvme` say, puts a fast tier of `VMSIM_BS_FAST_BLOCKS` blocks (an eighth of
+ * the store by default) in front of that slow one.  Blocks start out in the slow tier.  A block that is read back twice recently is
+ * promoted to the fast tier; when the fast tier fills, a clock over its blocks halves their recent read counts and demotes those
+ * that have none, until a tenth of the tier is free.  Blocks move between tiers in the background, taking device time but not
+ * stalling the clock.  The blocks read from the fast tier and the blocks moved are counted in the library's statistics.
+ *
+ * The pages of files mapped by `vmsim_map_file()` are read from, and written back to, a device of their own, described in the same
+ * way by `VMSIM_FILE_DEVICE` (by default, the same device as the backing store's slow tier).  Its operations are timed as blocks'
+ * are, with each page's position in its file taking the place of a block number.
  */
 // =================================================================================================================================
 
@@ -22,6 +46,8 @@
 // INCLUDES
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include "vmsim.h"
 // =================================================================================================================================
@@ -32,9 +58,11 @@
 // FUNCTIONS
 
 /**
- * \brief  Initialize the simulated backing store device.
+ * \brief Initialize the simulated backing store device.
+ * \param clock The library's simulated clock, in nanoseconds, at which operations are issued, and which reads advance.
+ * \param stats The library's activity counts, to which the tiers' activity is added.
  */
-void bs_init  ();
+void bs_init       (uint64_t* clock, vmsim_stats_t* stats);
 
 /**
  * \brief  Read data from a block.
@@ -42,7 +70,7 @@ void bs_init  ();
  * \param  block_number The block number of the backing store to read.
  * \return whether the operation was successful.
  */
-bool bs_read  (vmsim_addr_t buffer, unsigned int block_number);
+bool bs_read       (vmsim_addr_t buffer, unsigned int block_number);
 
 /**
  * \brief  Write data to a block.
@@ -50,7 +78,54 @@ bool bs_read  (vmsim_addr_t buffer, unsigned int block_number);
  * \param  block_number The block number of the backing store to write.
  * \return whether the operation was successful.
  */
-bool bs_write (vmsim_addr_t buffer, unsigned int block_number);
+bool bs_write      (vmsim_addr_t buffer, unsigned int block_number);
+
+/**
+ * \brief Note that a block no longer holds anything, so that it gives up any place in the fast tier, and forgets its recent reads.
+ * \param block_number The block number of the backing store that was freed.
+ */
+void bs_release    (unsigned int block_number);
+
+/**
+ * \brief  Read a page of a mapped file.
+ * \param  buffer The _real_ address of a page into which to read.
+ * \param  fd     The file.
+ * \param  offset The offset within the file of the page, a multiple of the page size.
+ * \param  size   The number of bytes of the page that the mapping covers; the rest, like any part past the end of the file,
+ *                reads as zeros.
+ * \return whether the operation was successful.
+ */
+bool bs_file_read  (vmsim_addr_t buffer, int fd, uint64_t offset, size_t size);
+
+/**
+ * \brief  Write a page of a mapped file back to the file.
+ * \param  buffer The _real_ address of the page from which to write.
+ * \param  fd     The file.
+ * \param  offset The offset within the file of the page, a multiple of the page size.
+ * \param  size   The number of bytes of the page that the mapping covers, which are all that is written.
+ * \return whether the operation was successful.
+ */
+bool bs_file_write (vmsim_addr_t buffer, int fd, uint64_t offset, size_t size);
+
+/**
+ * \brief  Save the blocks in use and the state of the devices to a checkpoint.
+ * \param  file       The checkpoint, positioned at a multiple of the page size.
+ * \param  num_blocks The number of blocks in use, counting from block 0.
+ * \return whether the state was written successfully.
+ */
+bool bs_checkpoint (FILE* file, unsigned int num_blocks);
+
+/**
+ * \brief  Restore the blocks and the state of the devices from a checkpoint written by `bs_checkpoint()`.
+ * \param  file       The checkpoint, positioned where `bs_checkpoint()` began writing, and left positioned after what it wrote.
+ * \param  num_blocks The number of blocks in use, as given to `bs_checkpoint()`.
+ * \return whether the checkpoint was restored; if the store is not configured with the same size and tiers, or came from the
+ *         host's pool of huge pages, nothing is changed.
+ *
+ * The blocks are mapped from the file rather than read, so each is read only when it is first touched.  The devices themselves
+ * may differ from those checkpointed, to see how a warmed-up run fares on other hardware.
+ */
+bool bs_restore    (FILE* file, unsigned int num_blocks);
 // =================================================================================================================================
 
 
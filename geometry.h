@@ -0,0 +1,116 @@
+// =================================================================================================================================
+/**
+ * \file   geometry.h
+ * \brief  The page size and page table geometry shared by the modules of the `vmsim` library.
+ *
+ * The page size is fixed at build time by defining `VMSIM_PAGE_SHIFT` (12 for 4 KB pages, the default; 14 for 16 KB; 16 for
+ * 64 KB), so that every shift and mask below is a compile-time constant.  Each page table fills exactly one page, so the number of
+ * index bits per level follows from the page size and from the width of a page table entry.  Backing store blocks are the same
+ * size as pages.
+ */
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_GEOMETRY_H)
+#define _GEOMETRY_H
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// INCLUDES
+
+#include "vmsim.h"
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// SIZES
+
+#define KB(n)      (n * 1024)
+#define MB(n)      (KB(n) * 1024)
+#define GB(n)      (MB(n) * 1024)
+
+#if !defined (VMSIM_PAGE_SHIFT)
+#define VMSIM_PAGE_SHIFT 12
+#endif
+
+#define PAGE_SHIFT                 VMSIM_PAGE_SHIFT
+#define PAGESIZE                   (1 << PAGE_SHIFT)
+#define BLOCK_SIZE                 PAGESIZE
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// PAGE TABLE SHAPE
+
+// The 32-bit space always uses two levels.  The 64-bit one defaults to four, but may use as many as fit in 64 bits (at most five).
+#if defined (VMSIM_64BIT)
+#define PTE_SIZE_SHIFT             3
+#define INDEX_BITS                 (PAGE_SHIFT - PTE_SIZE_SHIFT)
+#if ((64 - PAGE_SHIFT) / INDEX_BITS) >= 5
+#define MAX_PT_LEVELS              5
+#else
+#define MAX_PT_LEVELS              ((64 - PAGE_SHIFT) / INDEX_BITS)
+#endif
+#if MAX_PT_LEVELS >= 4
+#define DEFAULT_PT_LEVELS          4
+#else
+#define DEFAULT_PT_LEVELS          MAX_PT_LEVELS
+#endif
+#else
+#define PTE_SIZE_SHIFT             2
+#define INDEX_BITS                 (PAGE_SHIFT - PTE_SIZE_SHIFT)
+#define DEFAULT_PT_LEVELS          2
+#define MAX_PT_LEVELS              2
+#endif
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// ADDRESS FIELDS
+
+#define OFFSET_MASK             (PAGESIZE - 1)
+#define PAGE_NUMBER_MASK        (~((vmsim_addr_t) OFFSET_MASK))
+#define INDEX_MASK              ((1 << INDEX_BITS) - 1)
+#define GET_INDEX(addr, height) ((addr >> (PAGE_SHIFT + (height) * INDEX_BITS)) & INDEX_MASK)
+#define GET_OFFSET(addr)        (addr & OFFSET_MASK)
+#define GET_PAGE_ADDR(addr)     (addr & PAGE_NUMBER_MASK)
+#define GET_FRAME(addr)         ((addr) >> PAGE_SHIFT)
+#define IS_ALIGNED(addr)        ((addr & OFFSET_MASK) == 0)
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// PAGE TABLE ENTRY FIELDS
+
+#define IS_RESIDENT(pte)        (pte & PTE_RESIDENT_BIT)
+#define IS_REFERENCED(pte)      (pte & PTE_REFERENCED_BIT)
+#define IS_DIRTY(pte)           (pte & PTE_DIRTY_BIT)
+#define SET_RESIDENT(pte)       (pte |= PTE_RESIDENT_BIT)
+#define SET_REFERENCED(pte)     (pte |= PTE_REFERENCED_BIT)
+#define SET_DIRTY(pte)          (pte |= PTE_DIRTY_BIT)
+#define CLEAR_RESIDENT(pte)     (pte &= ~PTE_RESIDENT_BIT)
+#define CLEAR_REFERENCED(pte)   (pte &= ~PTE_REFERENCED_BIT)
+#define CLEAR_DIRTY(pte)        (pte &= ~PTE_DIRTY_BIT)
+
+// A non-resident entry keeps its flag bits and holds the backing store block number above them.
+#define BLOCK_SHIFT             10
+#define FLAG_MASK               ((1 << BLOCK_SHIFT) - 1)
+#define GET_BLOCK(pte)          (pte >> BLOCK_SHIFT)
+#define SET_BLOCK(pte, block)   (pte = (pte & FLAG_MASK) | ((pt_entry_t) (block) << BLOCK_SHIFT))
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+#endif // _GEOMETRY_H
+// =================================================================================================================================
@@ -0,0 +1,123 @@
+// =================================================================================================================================
+/**
+ * \file   host.c
+ * \brief  The host memory module of the `vmsim` library.
+ *
+ * Transparent huge pages are used only where a mapping covers whole, aligned huge pages, so the region is carved out of a larger
+ * reservation at a huge page boundary, and the reservation's ends are handed back.
+ */
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// INCLUDES
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "geometry.h"
+#include "host.h"
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// CONSTANTS AND MACRO FUNCTIONS
+
+// The size of a huge page of the host, to which regions are aligned and, from the pool, rounded.
+#define HUGE_PAGE_SIZE MB(2)
+
+// The ways in which a region may be backed.
+typedef enum {
+  HOST_NORMAL,
+  HOST_THP,
+  HOST_HUGETLB
+} host_pages_t;
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+static host_pages_t
+host_pages () {
+
+  char* host_pages_envvar = getenv("VMSIM_HOST_PAGES");
+  if (host_pages_envvar == NULL || strcmp(host_pages_envvar, "normal") == 0) {
+    return HOST_NORMAL;
+  } else if (strcmp(host_pages_envvar, "thp") == 0) {
+    return HOST_THP;
+  } else if (strcmp(host_pages_envvar, "hugetlb") == 0) {
+    return HOST_HUGETLB;
+  }
+  fprintf(stderr, "ERROR:\thost_map():\tUnknown VMSIM_HOST_PAGES %s\n", host_pages_envvar);
+  abort();
+
+} // host_pages ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void*
+host_map (size_t size, bool* hugetlb) {
+
+  host_pages_t pages = host_pages();
+  *hugetlb = false;
+
+  // Take the region from the pool if asked to.  The whole of it is reserved up front, so a pool that is too small is found out now
+  // rather than at some later fault.
+  if (pages == HOST_HUGETLB) {
+    size_t rounded = (size + HUGE_PAGE_SIZE - 1) & ~((size_t) HUGE_PAGE_SIZE - 1);
+    void*  base    = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (base != MAP_FAILED) {
+      *hugetlb = true;
+      return base;
+    }
+    fprintf(stderr, "WARNING:\thost_map():\tToo few huge pages for %lu bytes; using transparent huge pages\n",
+            (unsigned long) size);
+    pages = HOST_THP;
+  }
+
+  if (pages == HOST_NORMAL) {
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    assert(base != MAP_FAILED);
+    return base;
+  }
+
+  // Reserve a huge page more than asked for, keep the aligned part, and ask for it to be backed by huge pages.
+  uint8_t* reserved = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1,
+                           0);
+  assert(reserved != MAP_FAILED);
+  uint8_t* base = (uint8_t*) (((uintptr_t) reserved + HUGE_PAGE_SIZE - 1) & ~((uintptr_t) HUGE_PAGE_SIZE - 1));
+  if (base > reserved) {
+    munmap(reserved, base - reserved);
+  }
+  munmap(base + size, (reserved + HUGE_PAGE_SIZE) - base);
+  madvise(base, size, MADV_HUGEPAGE);
+  return base;
+
+} // host_map ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void
+host_discard (void* base, size_t size) {
+
+  if (size == 0) {
+    return;
+  }
+  void* mapped = mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+  if (mapped == MAP_FAILED) {
+    memset(base, 0, size);
+  } else if (host_pages() != HOST_NORMAL) {
+    madvise(base, size, MADV_HUGEPAGE);
+  }
+
+} // host_discard ()
+// =================================================================================================================================
@@ -0,0 +1,66 @@
+// =================================================================================================================================
+/**
+ * \file   host.h
+ * \brief  The interface for mapping the host memory that backs the library's large regions.
+ *
+ * Real memory and the backing store are each one large anonymous mapping, and with ordinary 4 KB host pages, a workload that
+ * ranges over either of them misses in the host's TLB often.  The `VMSIM_HOST_PAGES` environment variable chooses how they are
+ * backed instead:
+ *
+ * - `normal`:   ordinary host pages (the default).
+ * - `thp`:      transparent huge pages, requested with `madvise(MADV_HUGEPAGE)` over a mapping aligned to the huge page size.
+ * - `hugetlb`:  pages from the host's pool of huge pages, mapped with `MAP_HUGETLB`.  Should the pool be too small, the mapping
+ *               falls back to transparent huge pages, with a warning.
+ *
+ * A region backed by `hugetlb` cannot be split below the huge page size, so a checkpoint cannot be mapped over it by
+ * `vmsim_restore()`.
+ */
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_HOST_H)
+#define _HOST_H
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// INCLUDES
+
+#include <stdbool.h>
+#include <stddef.h>
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// FUNCTIONS
+
+/**
+ * \brief  Map a region of host memory, backed as `VMSIM_HOST_PAGES` asks.  Host memory is committed only as it is touched, and it
+ *         reads as zeros until it is written.
+ * \param  size    The size of the region, in bytes.
+ * \param  hugetlb A pointer to a space into which to store whether the region came from the host's pool of huge pages.
+ * \return the base address of the region.
+ */
+void* host_map     (size_t size, bool* hugetlb);
+
+/**
+ * \brief Hand part of a region back to the host, so that it reads as zeros until it is written again.  Fresh anonymous memory is
+ *        mapped over it, rather than the old pages merely being discarded, since a part that was mapped from a file would otherwise
+ *        read as the file's contents.  Should the part not be replaceable, as within the host's pool of huge pages, it is cleared.
+ * \param base The base address of the part, which must be a multiple of the host's page size.
+ * \param size The size of the part, in bytes.
+ */
+void  host_discard (void* base, size_t size);
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+#endif // _HOST_H
+// =================================================================================================================================
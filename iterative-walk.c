@@ -73,11 +73,11 @@ populate (vmsim_addr_t array, unsigned int length) {
   for (uint64_t i = 0; i < length; i += 1) {
 
     vmsim_addr_t addr = array + (i * sizeof(i));
-    vmsim_write(&i, addr, sizeof(i));
+    vmsim_store_u64(addr, i);
     if (debug) {
-      uint64_t value;
-      vmsim_read(&value, addr, sizeof(value));
-      fprintf(stderr, "DEBUG:\tpopulate():\t0x%x[%ld] = %ld\n", array, i, value);
+      uint64_t value = vmsim_load_u64(addr);
+      fprintf(stderr, "DEBUG:\tpopulate():\t0x%llx[%llu] = %llu\n", (unsigned long long) array, (unsigned long long) i,
+              (unsigned long long) value);
     }
 
   }
@@ -101,12 +101,12 @@ traverse (vmsim_addr_t array, unsigned int length) {
   for (uint64_t i = 0; i < length; i += 1) {
 
     vmsim_addr_t addr = array + (i * sizeof(i));
-    uint64_t current;
-    vmsim_read(&current, addr, sizeof(current));
+    uint64_t current = vmsim_load_u64(addr);
     sum += current;
-    vmsim_write(&sum, addr, sizeof(sum));
+    vmsim_store_u64(addr, sum);
     if (debug) {
-      fprintf(stderr, "DEBUG:\ttraverse():\t0x%x[%ld] <- %ld -> %ld\n", array, i, sum, current);
+      fprintf(stderr, "DEBUG:\ttraverse():\t0x%llx[%llu] <- %llu -> %llu\n", (unsigned long long) array, (unsigned long long) i,
+              (unsigned long long) sum, (unsigned long long) current);
     }
     
   }
@@ -13,6 +13,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "geometry.h"
 #include "mmu.h"
 #include "vmsim.h"
 // =================================================================================================================================
@@ -22,15 +23,25 @@
 // =================================================================================================================================
 // MACROS AND GLOBALS
 
-#define GET_UPPER_INDEX(addr) ((addr >> 22) & 0x3ff)
-#define GET_LOWER_INDEX(addr) ((addr >> 12) & 0x3ff)
-#define GET_OFFSET(addr)      (addr & 0xfff)
-#define GET_PAGE_ADDR(addr)   (addr & ~0xfff)
-#define IS_RESIDENT(pte)      (pte & PTE_RESIDENT_BIT)
-#define SET_REFERENCED(pte)   (pte |= PTE_REFERENCED_BIT)
-#define SET_DIRTY(pte)        (pte |= PTE_DIRTY_BIT)
+// The number of entries in the page-walk cache, which must be a power of two.
+#define WALK_CACHE_SIZE       64
+
+// Set a frame's bit in the bitmap of referenced frames, given its real base address.
+#define MARK_REFERENCED(real_addr) (referenced_frames[GET_FRAME(real_addr) >> 6] |= 1ULL << (GET_FRAME(real_addr) & 63))
 
 static vmsim_addr_t upper_pt_addr = 0;
+static unsigned int pt_levels     = 0;
+
+// The bitmap of referenced frames, in which every reference bit that is set is mirrored.
+static uint64_t*    referenced_frames = NULL;
+
+// The page-walk cache, which remembers the real base address of the last-level table that maps a given range of simulated pages,
+// so that a translation need not walk the upper levels.  A cached table address of 0 marks an unused slot.
+typedef struct {
+  vmsim_addr_t tag;
+  vmsim_addr_t table_addr;
+} walk_cache_entry_t;
+static walk_cache_entry_t walk_cache[WALK_CACHE_SIZE];
 
 #if !defined (MMU_DEBUG)
 static bool debug = false;
@@ -43,65 +54,100 @@ static bool debug = true;
 
 // =================================================================================================================================
 void
-mmu_init (vmsim_addr_t new_upper_pt_addr) {
+mmu_init (vmsim_addr_t new_upper_pt_addr, unsigned int new_pt_levels, uint64_t* new_referenced_frames) {
 
-  upper_pt_addr = new_upper_pt_addr;
+  upper_pt_addr     = new_upper_pt_addr;
+  pt_levels         = new_pt_levels;
+  referenced_frames = new_referenced_frames;
+  mmu_flush_walk_cache();
   
 }
 // =================================================================================================================================
 
 
 
+// =================================================================================================================================
+void
+mmu_flush_walk_cache () {
+
+  for (int i = 0; i < WALK_CACHE_SIZE; i += 1) {
+    walk_cache[i].table_addr = 0;
+  }
+
+}
+// =================================================================================================================================
+
+
+
 // =================================================================================================================================
 vmsim_addr_t
 mmu_translate (vmsim_addr_t sim_addr, bool write_operation) {
 
-  if (debug) fprintf(stderr, "DEBUG:\tmmu_translate():\tEntry on sim_addr = %8x\n", sim_addr);
+  if (debug) fprintf(stderr, "DEBUG:\tmmu_translate():\tEntry on sim_addr = %8llx\n", (unsigned long long) sim_addr);
   
-  // Sanity check:  There must be a page-table from which to start.
+  // Sanity check:  There must be a page-table from which to start, and the address must be within its reach.
   assert(upper_pt_addr != 0);
-
-  // Grab the upper table's entry.
-  vmsim_addr_t upper_index    = GET_UPPER_INDEX(sim_addr);
-  vmsim_addr_t upper_pte_addr = upper_pt_addr + (upper_index * sizeof(pt_entry_t));
-  pt_entry_t   upper_pte      = 0;
-  vmsim_read_real(&upper_pte, upper_pte_addr, sizeof(upper_pte));
-
-  if (debug) fprintf(stderr, "DEBUG:\tmmu_translate():\tupper_pte = %8x\n", upper_pte);
-
-  // If the lower table doesn't exist, trigger a mapping and restart.
-  if (upper_pte == 0) {
-    vmsim_map_fault(sim_addr);
-    return mmu_translate(sim_addr, write_operation);
+  assert(((uint64_t) sim_addr >> (PAGE_SHIFT + pt_levels * INDEX_BITS)) == 0);
+
+  // Start from the last-level table if the page-walk cache knows it, and from the upper table otherwise.
+  vmsim_addr_t        tag        = sim_addr >> (PAGE_SHIFT + INDEX_BITS);
+  walk_cache_entry_t* cached     = &walk_cache[tag & (WALK_CACHE_SIZE - 1)];
+  vmsim_addr_t        table_addr = upper_pt_addr;
+  unsigned int        height     = pt_levels - 1;
+  if (cached->table_addr != 0 && cached->tag == tag) {
+    table_addr = cached->table_addr;
+    height     = 0;
   }
 
-  // Get the pointer to the lower table.
-  vmsim_addr_t lower_pt_addr = GET_PAGE_ADDR(upper_pte);
+  // Walk down, one entry per level.
+  vmsim_addr_t pte_addr;
+  pt_entry_t   pte;
+  while (true) {
+
+    pte_addr = table_addr + (GET_INDEX(sim_addr, height) * sizeof(pt_entry_t));
+    vmsim_read_real(&pte, pte_addr, sizeof(pte));
+
+    if (debug) fprintf(stderr, "DEBUG:\tmmu_translate():\tlevel %u pte = %8llx\n", pt_levels - height, (unsigned long long) pte);
+
+    // If the next table or the page is unmapped, or if it is mapped and not resident, then hand the entry to the fault handler,
+    // and resume from that same entry.
+    if (!IS_RESIDENT(pte)) {
+      vmsim_map_fault(pte_addr, pt_levels - height);
+      vmsim_read_real(&pte, pte_addr, sizeof(pte));
+      assert(IS_RESIDENT(pte));
+    }
+
+    if (height == 0) {
+      break;
+    }
+
+    // Mark the table as referenced, so that the clock sees it in use if it is ever a candidate for eviction.
+    table_addr = GET_PAGE_ADDR(pte);
+    if (!IS_REFERENCED(pte)) {
+      SET_REFERENCED(pte);
+      vmsim_write_real(&pte, pte_addr, sizeof(pte));
+      MARK_REFERENCED(table_addr);
+    }
+
+    height    -= 1;
+    if (height == 0) {
+      cached->tag        = tag;
+      cached->table_addr = table_addr;
+    }
 
-  // Grab the lower table's entry.
-  vmsim_addr_t lower_index    = GET_LOWER_INDEX(sim_addr);
-  vmsim_addr_t lower_pte_addr = lower_pt_addr + (lower_index * sizeof(pt_entry_t));
-  pt_entry_t   lower_pte      = 0;
-  vmsim_read_real(&lower_pte, lower_pte_addr, sizeof(lower_pte));
-
-  if (debug) fprintf(stderr, "DEBUG:\tmmu_translate():\tlower_pte = %8x\n", lower_pte);
-  
-  // If the page is unmapped, or if it is mapped and not resident, then trigger a fault and restart.
-  if ((lower_pte == 0) || !IS_RESIDENT(lower_pte)) {
-    vmsim_map_fault(sim_addr);
-    return mmu_translate(sim_addr, write_operation);
   }
 
   // Set the reference bit and, if appropriate, the dirty bit.
-  SET_REFERENCED(lower_pte);
+  SET_REFERENCED(pte);
   if (write_operation) {
-    SET_DIRTY(lower_pte);
+    SET_DIRTY(pte);
   }
-  vmsim_write_real(&lower_pte, lower_pte_addr, sizeof(lower_pte));
+  vmsim_write_real(&pte, pte_addr, sizeof(pte));
+  MARK_REFERENCED(GET_PAGE_ADDR(pte));
   
   // Glue together the simulated page address and the offset.
-  vmsim_addr_t real_addr = GET_PAGE_ADDR(lower_pte) | GET_OFFSET(sim_addr);
-  if (debug) fprintf(stderr, "DEBUG:\tmmu_translate():\t%x -> %x\n", sim_addr, real_addr);
+  vmsim_addr_t real_addr = GET_PAGE_ADDR(pte) | GET_OFFSET(sim_addr);
+  if (debug) fprintf(stderr, "DEBUG:\tmmu_translate():\t%llx -> %llx\n", (unsigned long long) sim_addr, (unsigned long long) real_addr);
   return real_addr;
   
 }
@@ -21,6 +21,7 @@
 // INCLUDES
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "vmsim.h"
 // =================================================================================================================================
 
@@ -32,11 +33,23 @@
 /**
  * \brief Initialize the MMU.
  * \param upper_pt_addr The real base address of the upper page table.
+ * \param pt_levels     The number of page table levels, including the upper one.
+ * \param referenced_frames A bitmap with one bit per real frame, 64 frames to a word, in which the MMU sets a frame's bit whenever
+ *                          it sets the reference bit of the entry that maps that frame.
  *
  * This function stores the given real address of the upper page table.  Doing so is analogous to setting a hardware MMU's _page
  * table register (PTR)_ with the physical base address of the upper PT.
  */
-void         mmu_init      (vmsim_addr_t upper_pt_addr);
+void         mmu_init      (vmsim_addr_t upper_pt_addr, unsigned int pt_levels, uint64_t* referenced_frames);
+
+/**
+ * \brief Discard every entry of the page-walk cache.
+ *
+ * The MMU caches the real location of recently used last-level page tables, so that most translations skip the upper levels of
+ * the walk.  This function must be called whenever a page table is evicted or released, just as an OS must flush a hardware
+ * page-walk cache when it changes the upper levels of a page table.
+ */
+void         mmu_flush_walk_cache ();
 
 /**
  * \brief  Translate a simulated address into a physical address.
@@ -45,8 +58,9 @@ void         mmu_init      (vmsim_addr_t upper_pt_addr);
  * \return the real address to which the simulated address maps.
  *
  * This function walks the multi-level page table to find the mapping from the given simulated address to its corresponding real
- * address.  If the simulated address is not yet mapped to a real address, then this function calls `vmsim_map_fault()` (mimicking
- * an _address translation interrupt_, or _page fault_, in hardware) to have the mapping created, and then restarts the translation.
+ * address.  If an entry along the way is not resident, then this function passes that entry to `vmsim_map_fault()` (mimicking an
+ * _address translation interrupt_, or _page fault_, in hardware) to have the mapping created, and then resumes the walk from that
+ * entry.
  */
 vmsim_addr_t mmu_translate (vmsim_addr_t sim_addr, bool write_operation);
 // =================================================================================================================================
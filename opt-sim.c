@@ -0,0 +1,383 @@
+// =================================================================================================================================
+/**
+ * \file   opt-sim.c
+ * \brief  Replay a recorded page reference stream under Belady's optimal (OPT/MIN) replacement and under the clock algorithm, and
+ *         report how far the clock falls short of optimal.
+ *
+ * The reference stream is the raw array of 64-bit simulated page numbers that `vmsim` writes when `VMSIM_RECORD` is set.  A
+ * backward pass first finds, for each reference, when the same page is next referenced.  OPT then evicts the resident page whose
+ * next reference is furthest away, kept at the top of an indexed heap of the resident pages, so each reference costs
+ * O(log frames), and the whole replay O(n log n).  The clock is replayed the same way `find_lru()` runs it:  pages are referenced
+ * when loaded, and the hand moves past each victim.  Only simulated pages are counted; the frames that `vmsim` spends on page
+ * tables are not.
+ **/
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// INCLUDES
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// CONSTANTS AND MACRO FUNCTIONS
+
+/** The "next reference" of a page that is never referenced again. */
+#define NEVER UINT64_MAX
+
+/** The marker of an empty slot in the page table of this program. */
+#define EMPTY_SLOT UINT64_MAX
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// TYPES
+
+/** What is known about each distinct page. */
+typedef struct {
+  uint64_t page;       /**< The page number, or `EMPTY_SLOT`. */
+  uint64_t last;       /**< During the backward pass, the most recent (earliest) reference seen; during OPT, the next one. */
+  int64_t  heap_pos;   /**< During OPT, the page's position in the heap, or -1 if not resident. */
+  int64_t  frame;      /**< During the clock replay, the page's frame, or -1 if not resident. */
+} page_info_t;
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// GLOBALS
+
+static page_info_t* pages      = NULL;
+static uint64_t     page_mask  = 0;
+static uint64_t     page_count = 0;
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief Display the proper usage and end the process with an error code.
+ * \param invocation The command-line text given to run the executable.
+ */
+void
+show_usage_and_exit (char* invocation) {
+
+  fprintf(stderr, "USAGE: %s <reference record> <frames> [<frames> ...]\n", invocation);
+  exit(1);
+
+} // show_usage_and_exit ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief Create an empty page table of this program.
+ * \param slots The number of slots, which must be a power of two.
+ */
+void
+create_pages (uint64_t slots) {
+
+  pages = malloc(slots * sizeof(page_info_t));
+  assert(pages != NULL);
+  for (uint64_t i = 0; i < slots; i += 1) {
+    pages[i].page = EMPTY_SLOT;
+  }
+  page_mask  = slots - 1;
+  page_count = 0;
+
+} // create_pages ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief  Find the information about a page, creating it if it is new.
+ * \param  page The page number.
+ * \return the page's information.
+ *
+ * The table doubles whenever it becomes half full, which moves every entry; all pages are created in the backward pass, before any
+ * pointers to them are kept.
+ */
+page_info_t*
+lookup (uint64_t page) {
+
+  uint64_t slot = (page * 0x9e3779b97f4a7c15ULL) & page_mask;
+  while (pages[slot].page != page) {
+    if (pages[slot].page == EMPTY_SLOT) {
+
+      if (2 * (page_count + 1) > page_mask + 1) {
+        page_info_t* old_pages = pages;
+        uint64_t     old_slots = page_mask + 1;
+        create_pages(2 * old_slots);
+        for (uint64_t i = 0; i < old_slots; i += 1) {
+          if (old_pages[i].page != EMPTY_SLOT) {
+            *lookup(old_pages[i].page) = old_pages[i];
+          }
+        }
+        free(old_pages);
+        return lookup(page);
+      }
+
+      pages[slot].page     = page;
+      pages[slot].last     = NEVER;
+      pages[slot].heap_pos = -1;
+      pages[slot].frame    = -1;
+      page_count += 1;
+      break;
+
+    }
+    slot = (slot + 1) & page_mask;
+  }
+  return &pages[slot];
+
+} // lookup ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// THE OPT HEAP
+//
+// A binary max-heap of the resident pages, ordered by next reference, in which each page knows its own position so that its key
+// can be changed in place.
+
+static page_info_t** heap      = NULL;
+static uint64_t      heap_size = 0;
+
+static void heap_swap (uint64_t i, uint64_t j) {
+
+  page_info_t* tmp = heap[i];
+  heap[i] = heap[j];
+  heap[j] = tmp;
+  heap[i]->heap_pos = i;
+  heap[j]->heap_pos = j;
+
+}
+
+static void heap_sift_up (uint64_t i) {
+
+  while (i > 0 && heap[(i - 1) / 2]->last < heap[i]->last) {
+    heap_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+
+}
+
+static void heap_sift_down (uint64_t i) {
+
+  while (true) {
+    uint64_t largest = i;
+    uint64_t left    = (2 * i) + 1;
+    uint64_t right   = left + 1;
+    if (left < heap_size && heap[left]->last > heap[largest]->last) {
+      largest = left;
+    }
+    if (right < heap_size && heap[right]->last > heap[largest]->last) {
+      largest = right;
+    }
+    if (largest == i) {
+      return;
+    }
+    heap_swap(i, largest);
+    i = largest;
+  }
+
+}
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief  Count the faults that OPT incurs.
+ * \param  trace  The page references.
+ * \param  next   For each reference, the index of the next reference to the same page, or `NEVER`.
+ * \param  length The number of references.
+ * \param  frames The number of frames of real memory.
+ * \return the number of faults.
+ */
+uint64_t
+run_opt (const uint64_t* trace, const uint64_t* next, uint64_t length, uint64_t frames) {
+
+  heap_size = 0;
+  uint64_t faults = 0;
+  for (uint64_t i = 0; i < length; i += 1) {
+
+    page_info_t* info = lookup(trace[i]);
+    info->last = next[i];
+
+    // A hit only moves the page's next reference further out.
+    if (info->heap_pos >= 0) {
+      heap_sift_up(info->heap_pos);
+      continue;
+    }
+
+    // A fault evicts the page referenced furthest in the future, if memory is full.
+    faults += 1;
+    if (heap_size == frames) {
+      heap[0]->heap_pos = -1;
+      heap_size -= 1;
+      if (heap_size > 0) {
+        heap[0] = heap[heap_size];
+        heap[0]->heap_pos = 0;
+        heap_sift_down(0);
+      }
+    }
+    heap[heap_size] = info;
+    info->heap_pos  = heap_size;
+    heap_size += 1;
+    heap_sift_up(info->heap_pos);
+
+  }
+
+  // Leave every page non-resident for the next run.
+  for (uint64_t i = 0; i < heap_size; i += 1) {
+    heap[i]->heap_pos = -1;
+  }
+  return faults;
+
+} // run_opt ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief  Count the faults that the clock algorithm incurs.
+ * \param  trace  The page references.
+ * \param  length The number of references.
+ * \param  frames The number of frames of real memory.
+ * \return the number of faults.
+ */
+uint64_t
+run_clock (const uint64_t* trace, uint64_t length, uint64_t frames) {
+
+  page_info_t** frame_pages = calloc(frames, sizeof(page_info_t*));
+  bool*         referenced  = calloc(frames, sizeof(bool));
+  assert(frame_pages != NULL && referenced != NULL);
+
+  uint64_t used   = 0;
+  uint64_t hand   = 0;
+  uint64_t faults = 0;
+  for (uint64_t i = 0; i < length; i += 1) {
+
+    page_info_t* info = lookup(trace[i]);
+    if (info->frame < 0) {
+
+      faults += 1;
+      uint64_t frame;
+      if (used < frames) {
+        frame = used;
+        used += 1;
+      } else {
+        while (referenced[hand]) {
+          referenced[hand] = false;
+          hand = (hand + 1) % frames;
+        }
+        frame = hand;
+        hand  = (hand + 1) % frames;
+        frame_pages[frame]->frame = -1;
+      }
+      frame_pages[frame] = info;
+      info->frame        = frame;
+
+    }
+    referenced[info->frame] = true;
+
+  }
+
+  for (uint64_t frame = 0; frame < used; frame += 1) {
+    frame_pages[frame]->frame = -1;
+  }
+  free(frame_pages);
+  free(referenced);
+  return faults;
+
+} // run_clock ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief The entry point to the simulator.
+ * \param argc The length of the command-line argument vector.
+ * \param argv The vector of command-line arguments.
+ * \return the exit code for the process, where 0 indicates success, any other value indicates error.
+ */
+int
+main (int argc, char** argv) {
+
+  // Check usage.
+  if (argc < 3) {
+    show_usage_and_exit(argv[0]);
+  }
+
+  // Map the reference record.
+  int fd = open(argv[1], O_RDONLY);
+  if (fd < 0) {
+    perror(argv[1]);
+    return 1;
+  }
+  struct stat status;
+  fstat(fd, &status);
+  uint64_t length = status.st_size / sizeof(uint64_t);
+  if (length == 0) {
+    fprintf(stderr, "%s: no references\n", argv[1]);
+    return 1;
+  }
+  const uint64_t* trace = mmap(NULL, length * sizeof(uint64_t), PROT_READ, MAP_PRIVATE, fd, 0);
+  assert(trace != MAP_FAILED);
+  madvise((void*) trace, length * sizeof(uint64_t), MADV_SEQUENTIAL);
+
+  // Find each reference's next use with a backward pass.
+  create_pages(1024);
+  uint64_t* next = mmap(NULL, length * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  assert(next != MAP_FAILED);
+  for (uint64_t i = length; i > 0; i -= 1) {
+    page_info_t* info = lookup(trace[i - 1]);
+    next[i - 1] = info->last;
+    info->last  = i - 1;
+  }
+  uint64_t distinct = page_count;
+
+  // Replay at each number of frames.
+  printf("references,distinct_pages,frames,opt_faults,clock_faults,gap,gap_percent\n");
+  for (int arg = 2; arg < argc; arg += 1) {
+
+    errno = 0;
+    uint64_t frames = strtoull(argv[arg], NULL, 10);
+    if (errno != 0 || frames < 1) {
+      show_usage_and_exit(argv[0]);
+    }
+
+    heap = realloc(heap, frames * sizeof(page_info_t*));
+    assert(heap != NULL);
+    uint64_t opt_faults   = run_opt(trace, next, length, frames);
+    uint64_t clock_faults = run_clock(trace, length, frames);
+    printf("%llu,%llu,%llu,%llu,%llu,%llu,%.2f\n", (unsigned long long) length, (unsigned long long) distinct,
+           (unsigned long long) frames, (unsigned long long) opt_faults, (unsigned long long) clock_faults,
+           (unsigned long long) (clock_faults - opt_faults), 100.0 * (clock_faults - opt_faults) / opt_faults);
+
+  }
+
+  return 0;
+
+} // main ()
+// =================================================================================================================================
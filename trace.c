@@ -0,0 +1,201 @@
+// =================================================================================================================================
+/**
+ * \file   trace.c
+ * \brief  The event trace module of the `vmsim` library.
+ *
+ * Each ring has a single producer, the thread that owns it, and a single consumer, the drain thread.  The producer alone advances
+ * `head` and the consumer alone advances `tail`, each publishing its progress to the other with a release store, so no locks are
+ * needed.  Rings are pushed onto a list when their threads record their first events, and live until the library is unloaded.
+ */
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// INCLUDES
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// CONSTANTS AND MACRO FUNCTIONS
+
+// The number of records in each ring, which must be a power of two.
+#define RING_SIZE        65536
+
+// How long the drain thread sleeps between passes over the rings, in nanoseconds.
+#define DRAIN_INTERVAL   1000000
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// TYPES AND GLOBALS
+
+// One thread's ring.  The two indices count records ever produced and consumed, and are kept on cache lines of their own so that
+// the two sides do not contend for them.
+typedef struct trace_ring {
+  trace_record_t     records[RING_SIZE];
+  uint64_t           head __attribute__ ((aligned (64)));
+  uint64_t           tail __attribute__ ((aligned (64)));
+  uint64_t           dropped;
+  struct trace_ring* next;
+} trace_ring_t;
+
+bool                     trace_enabled = false;
+
+static FILE*             trace_file    = NULL;
+static trace_ring_t*     rings         = NULL;
+static __thread trace_ring_t* my_ring  = NULL;
+static __thread uint32_t my_thread     = 0;
+static pthread_t         drain_thread;
+static bool              stopping      = false;
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+static void
+drain_rings () {
+
+  for (trace_ring_t* ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = ring->tail;
+
+    // Write out the records between the two indices, in at most two pieces if they wrap around the end of the ring.
+    while (tail != head) {
+      uint64_t start = tail & (RING_SIZE - 1);
+      uint64_t count = head - tail;
+      if (start + count > RING_SIZE) {
+        count = RING_SIZE - start;
+      }
+      fwrite(&ring->records[start], sizeof(trace_record_t), count, trace_file);
+      tail += count;
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+  }
+
+} // drain_rings ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+static void*
+drain_loop (void* unused) {
+
+  struct timespec interval = { 0, DRAIN_INTERVAL };
+  while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+    drain_rings();
+    nanosleep(&interval, NULL);
+  }
+  return NULL;
+
+} // drain_loop ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void
+trace_init () {
+
+  char* trace_envvar = getenv("VMSIM_TRACE");
+  if (trace_envvar == NULL || trace_enabled) {
+    return;
+  }
+
+  trace_file = fopen(trace_envvar, "w");
+  if (trace_file == NULL) {
+    fprintf(stderr, "ERROR:\ttrace_init():\tCannot open trace %s\n", trace_envvar);
+    abort();
+  }
+  trace_header_t header;
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version     = TRACE_VERSION;
+  header.record_size = sizeof(trace_record_t);
+  fwrite(&header, sizeof(header), 1, trace_file);
+
+  int created = pthread_create(&drain_thread, NULL, drain_loop, NULL);
+  assert(created == 0);
+  trace_enabled = true;
+
+} // trace_init ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void
+trace_fini () {
+
+  if (!trace_enabled) {
+    return;
+  }
+  trace_enabled = false;
+
+  __atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+  pthread_join(drain_thread, NULL);
+  drain_rings();
+
+  uint64_t dropped = 0;
+  for (trace_ring_t* ring = rings; ring != NULL; ring = ring->next) {
+    dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+  }
+  if (dropped > 0) {
+    fprintf(stderr, "WARNING:\ttrace_fini():\t%lu events dropped from full rings\n", (unsigned long) dropped);
+  }
+  fclose(trace_file);
+  trace_file = NULL;
+
+} // trace_fini ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void
+trace_event (trace_event_type_t type, uint64_t addr, uint64_t arg) {
+
+  // Give the thread a ring of its own the first time, and push it onto the list.
+  trace_ring_t* ring = my_ring;
+  if (ring == NULL) {
+    ring = calloc(1, sizeof(trace_ring_t));
+    assert(ring != NULL);
+    ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    my_ring   = ring;
+    my_thread = syscall(SYS_gettid);
+  }
+
+  // Drop the event if the drain thread has fallen a whole ring behind.
+  uint64_t head = ring->head;
+  if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == RING_SIZE) {
+    __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  trace_record_t* record = &ring->records[head & (RING_SIZE - 1)];
+  record->time   = ((uint64_t) now.tv_sec * 1000000000) + now.tv_nsec;
+  record->addr   = addr;
+  record->arg    = arg;
+  record->type   = type;
+  record->thread = my_thread;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+} // trace_event ()
+// =================================================================================================================================
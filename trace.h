@@ -0,0 +1,121 @@
+// =================================================================================================================================
+/**
+ * \file   trace.h
+ * \brief  The interface for the event trace module of the `vmsim` library.
+ *
+ * When the `VMSIM_TRACE` environment variable names a file, the library records an event for each step of its paging activity:
+ * the beginning and end of each fault, each victim chosen by the clock, each backing store read and write, and each time the clock
+ * hand wraps around.  Each thread appends its events to a lock-free ring buffer of its own, and a background thread drains the rings
+ * into the file.  The file is a `trace_header_t` followed by `trace_record_t` records, which `trace2json` converts into the JSON
+ * format of the Chrome and Perfetto trace viewers.  When tracing is off, each event costs a single predictable branch.
+ */
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_TRACE_H)
+#define _TRACE_H
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// INCLUDES
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "vmsim.h"
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// TYPES
+
+/** The kinds of event. */
+typedef enum {
+  TRACE_FAULT_BEGIN,   /**< A fault on a non-resident entry; `addr` is the simulated base of the page or range, `arg` its level. */
+  TRACE_FAULT_END,     /**< The end of the fault; `addr` is as for its beginning, `arg` the frame that it filled. */
+  TRACE_VICTIM,        /**< A frame chosen for eviction; `addr` is the simulated base of its contents, `arg` the frame. */
+  TRACE_BS_READ,       /**< A block read from the backing store; `addr` is the simulated base of its contents, `arg` the block. */
+  TRACE_BS_WRITE,      /**< A block written to the backing store; `addr` and `arg` are as for a read. */
+  TRACE_CLOCK_WRAP,    /**< The clock hand wrapping around to the first frame of the pool. */
+  TRACE_NUM_TYPES
+} trace_event_type_t;
+
+/** The header at the start of a trace file. */
+typedef struct {
+  char     magic[8];         /**< `TRACE_MAGIC`, without a terminator. */
+  uint32_t version;          /**< `TRACE_VERSION`. */
+  uint32_t record_size;      /**< The size of each record, in bytes. */
+} trace_header_t;
+
+/** One event, as it is stored both in the ring buffers and in the trace file. */
+typedef struct {
+  uint64_t time;             /**< The time of the event, in nanoseconds of `CLOCK_MONOTONIC`. */
+  uint64_t addr;             /**< A simulated address, as described for each kind of event. */
+  uint64_t arg;              /**< A further value, as described for each kind of event. */
+  uint32_t type;             /**< The kind of event, a `trace_event_type_t`. */
+  uint32_t thread;           /**< The kernel thread ID of the thread that recorded the event. */
+} trace_record_t;
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// CONSTANTS AND MACRO FUNCTIONS
+
+#define TRACE_MAGIC   "VMSTRACE"
+#define TRACE_VERSION 1
+
+/** Record an event, if tracing is on. */
+#define TRACE(type, addr, arg)                      \
+  do {                                              \
+    if (__builtin_expect(trace_enabled, false)) {   \
+      trace_event((type), (addr), (arg));           \
+    }                                               \
+  } while (false)
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// GLOBALS
+
+/** Whether events are being recorded. */
+extern bool trace_enabled;
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// FUNCTIONS
+
+/**
+ * \brief Start tracing if `VMSIM_TRACE` names a file, creating that file and starting the thread that drains the rings into it.
+ */
+void trace_init  ();
+
+/**
+ * \brief Stop tracing, draining every ring into the file and closing it.
+ */
+void trace_fini  ();
+
+/**
+ * \brief Record an event in the calling thread's ring.  If the ring is full, the event is dropped and counted.  Use `TRACE()`
+ *        rather than calling this function directly.
+ * \param type The kind of event.
+ * \param addr A simulated address, as described for each kind of event.
+ * \param arg  A further value, as described for each kind of event.
+ */
+void trace_event (trace_event_type_t type, uint64_t addr, uint64_t arg);
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+#endif // _TRACE_H
+// =================================================================================================================================
@@ -0,0 +1,161 @@
+// =================================================================================================================================
+/**
+ * \file   trace2json.c
+ * \brief  Convert an event trace recorded by `vmsim` (with `VMSIM_TRACE` set) into the JSON trace event format, for viewing in
+ *         `chrome://tracing` or the Perfetto UI.
+ *
+ * Each fault becomes a duration event spanning its beginning and end, so that the evictions and backing store traffic that it
+ * caused nest beneath it; every other event becomes an instant event.  Each thread gets a track of its own, and times are shown
+ * relative to the earliest event of the trace.
+ **/
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// INCLUDES
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// CONSTANTS AND MACRO FUNCTIONS
+
+/** The number of records read at a time. */
+#define CHUNK_RECORDS 4096
+
+/** The name shown for each kind of event, in `trace_event_type_t` order. */
+static const char* event_names[TRACE_NUM_TYPES] = { "fault", "fault", "victim", "bs_read", "bs_write", "clock_wrap" };
+
+/** The name of each event's `arg`, in `trace_event_type_t` order. */
+static const char* arg_names[TRACE_NUM_TYPES]   = { "level", "frame", "frame", "block", "block", NULL };
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief Display the proper usage and end the process with an error code.
+ * \param invocation The command-line text given to run the executable.
+ */
+void
+show_usage_and_exit (char* invocation) {
+
+  fprintf(stderr, "USAGE: %s <trace file> [<JSON file>]\n", invocation);
+  exit(1);
+
+} // show_usage_and_exit ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief Write one record as a JSON trace event.
+ * \param out        The JSON output.
+ * \param record     The record.
+ * \param start_time The time of the earliest record, in nanoseconds.
+ * \param first      Whether this is the first event written.
+ */
+void
+write_event (FILE* out, const trace_record_t* record, uint64_t start_time, bool first) {
+
+  const char* phase = "i";
+  if (record->type == TRACE_FAULT_BEGIN) {
+    phase = "B";
+  } else if (record->type == TRACE_FAULT_END) {
+    phase = "E";
+  }
+
+  fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"vmsim\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u", first ? "" : ",",
+          event_names[record->type], phase, (record->time - start_time) / 1000.0, record->thread);
+  if (phase[0] == 'i') {
+    fprintf(out, ",\"s\":\"t\"");
+  }
+  if (arg_names[record->type] != NULL) {
+    fprintf(out, ",\"args\":{\"addr\":\"0x%llx\",\"%s\":%llu}", (unsigned long long) record->addr, arg_names[record->type],
+            (unsigned long long) record->arg);
+  }
+  fprintf(out, "}");
+
+} // write_event ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief The entry point to the converter.
+ * \param argc The length of the command-line argument vector.
+ * \param argv The vector of command-line arguments.
+ * \return the exit code for the process, where 0 indicates success, any other value indicates error.
+ */
+int
+main (int argc, char** argv) {
+
+  // Check usage.
+  if (argc != 2 && argc != 3) {
+    show_usage_and_exit(argv[0]);
+  }
+
+  // Open the files, and check that the trace is one that this program understands.
+  FILE* in = fopen(argv[1], "r");
+  if (in == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  FILE* out = stdout;
+  if (argc == 3) {
+    out = fopen(argv[2], "w");
+    if (out == NULL) {
+      perror(argv[2]);
+      return 1;
+    }
+  }
+  trace_header_t header;
+  if (fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TRACE_VERSION || header.record_size != sizeof(trace_record_t)) {
+    fprintf(stderr, "%s: not a vmsim trace of version %d\n", argv[1], TRACE_VERSION);
+    return 1;
+  }
+
+  // Find the earliest time, since the threads' rings were drained in turn rather than in time order.
+  static trace_record_t records[CHUNK_RECORDS];
+  uint64_t start_time = UINT64_MAX;
+  size_t   count;
+  while ((count = fread(records, sizeof(trace_record_t), CHUNK_RECORDS, in)) > 0) {
+    for (size_t i = 0; i < count; i += 1) {
+      if (records[i].time < start_time) {
+        start_time = records[i].time;
+      }
+    }
+  }
+  fseek(in, sizeof(header), SEEK_SET);
+
+  // Convert the records a chunk at a time.
+  uint64_t converted = 0;
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  while ((count = fread(records, sizeof(trace_record_t), CHUNK_RECORDS, in)) > 0) {
+    for (size_t i = 0; i < count; i += 1) {
+      if (records[i].type >= TRACE_NUM_TYPES) {
+        fprintf(stderr, "%s: bad event type %u\n", argv[1], records[i].type);
+        return 1;
+      }
+      write_event(out, &records[i], start_time, converted == 0);
+      converted += 1;
+    }
+  }
+  fprintf(out, "\n]}\n");
+
+  fclose(in);
+  fclose(out);
+  return 0;
+
+} // main ()
+// =================================================================================================================================
@@ -14,14 +14,24 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <linux/userfaultfd.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include "bs.h"
+#include "geometry.h"
+#include "host.h"
 #include "mmu.h"
+#include "trace.h"
 #include "vmsim.h"
 // =================================================================================================================================
 
@@ -30,368 +40,2812 @@
 // =================================================================================================================================
 // CONSTANTS AND MACRO FUNCTIONS
 
-#define KB(n)      (n * 1024)
-#define MB(n)      (KB(n) * 1024)
-#define GB(n)      (MB(n) * 1024)
- 
 #define DEFAULT_REAL_MEMORY_SIZE   (MB(4) + KB(16)) //WAS MB(5)
-#define PAGESIZE                   KB(4)
-#define PT_AREA_SIZE               (MB(4) + KB(4))
-
-#define OFFSET_MASK           (PAGESIZE - 1)
-#define PAGE_NUMBER_MASK      (~OFFSET_MASK)
-#define GET_UPPER_INDEX(addr) ((addr >> 22) & 0x3ff)
-#define GET_LOWER_INDEX(addr) ((addr >> 12) & 0x3ff)
-#define GET_OFFSET(addr)      (addr & OFFSET_MASK)
-#define GET_PAGE_ADDR(addr)   (addr & PAGE_NUMBER_MASK)
-#define IS_ALIGNED(addr)      ((addr & OFFSET_MASK) == 0)
-
-#define IS_RESIDENT(pte)      (pte & PTE_RESIDENT_BIT)
-#define IS_REFERENCED(pte)    (pte & PTE_REFERENCED_BIT)
-#define IS_DIRTY(pte)         (pte & PTE_DIRTY_BIT)
-#define SET_RESIDENT(pte)     (pte |= PTE_RESIDENT_BIT)
-#define CLEAR_RESIDENT(pte)   (pte &= ~PTE_RESIDENT_BIT)
-#define CLEAR_REFERENCED(pte) (pte &= ~PTE_REFERENCED_BIT)
-#define CLEAR_DIRTY(pte)      (pte &= ~PTE_DIRTY_BIT)
-
-// The boundaries and size of the real memory region.
+
+// The simulated time of one memory access, in nanoseconds.
+#define DEFAULT_MEM_ACCESS_TIME    100
+
+// Every `NUMA_SAMPLE_PERIOD` translations, the next `NUMA_SAMPLE_SIZE` frames are sampled to find the node that uses each.
+#define NUMA_SAMPLE_PERIOD         4096
+#define NUMA_SAMPLE_SIZE           256
+
+// The last node of a frame whose page no sampled translation has yet been seen to use.
+#define NO_NODE                    UINT8_MAX
+
+// The page-fault frequency monitor's window of accesses, which slides a bucket at a time, and the fault rate, in faults per million
+// accesses, above which the simulation is thrashing unless told otherwise.  It stops thrashing at half that rate.
+#define PFF_BUCKETS                8
+#define DEFAULT_PFF_WINDOW         65536
+#define DEFAULT_PFF_HIGH           10000
+
+// The largest share of the pool, as a divisor, that a batch of accesses may hold pinned at once.
+#define BATCH_PIN_FRACTION         4
+
+// Identifies a checkpoint file, and its layout.
+#define CHECKPOINT_MAGIC           "VMSCKPT"
+#define CHECKPOINT_VERSION         4
+
+// Frame 0 is never used, so that a real address of 0 can mean "none"; frame 1 holds the upper (root) page table.
+#define NULL_FRAME                 0
+#define UPPER_PT_FRAME             1
+#define FIRST_POOL_FRAME           2
+
+// The boundaries and size of the real memory region, and the size to which it may grow, for which host address space is reserved.
+// Whether the region came from the host's pool of huge pages, which a checkpoint cannot be mapped over.
 static void*        real_base       = NULL;
 static void*        real_limit      = NULL;
 static uint64_t     real_size       = DEFAULT_REAL_MEMORY_SIZE;
+static uint64_t     max_real_size   = 0;
+static bool         real_hugetlb    = false;
+
+// The NUMA nodes among which the pool's frames are divided, each a contiguous run of frames with its own never-used frames and its
+// own released ones, which are kept on a stack within `free_frames` at the node's first frame.  Without `VMSIM_NUMA_NODES` there is
+// a single node.
+typedef struct {
+  uint64_t first_frame;
+  uint64_t end_frame;
+  uint64_t next_frame;
+  uint64_t num_free;
+} numa_node_t;
+static numa_node_t* nodes           = NULL;
+static unsigned int num_nodes       = 1;
+static uint64_t     frames_per_node = 0;
+static uint64_t*    free_frames     = NULL;
+
+// Whether simulated pages are spread over the nodes by page number rather than placed on the node of the thread that first touches
+// them; whether pages are migrated to the node that is using them; and the calling thread's own node.
+static bool            interleave      = false;
+static bool            migrate         = true;
+static __thread unsigned int thread_node = 0;
+
+// The frame at which the next sample for migration starts, and the number of translations until then.
+static uint64_t     sample_hand      = FIRST_POOL_FRAME;
+static uint64_t     sample_countdown = NUMA_SAMPLE_PERIOD;
+
+// The base real address of the upper page table.
+static vmsim_addr_t upper_pt        = 0;
+
+// The number of page table levels, including the upper table.
+static unsigned int pt_levels       = DEFAULT_PT_LEVELS;
+
+// Whether lower page tables with no resident pages may themselves be evicted to the backing store.
+static bool         pageable_pts    = false;
+
+// Used by the heap allocator, the address of the next free simulated address.
+static vmsim_addr_t sim_free_addr   = 0;
+
+// The blocks handed out by the heap allocator, in address order, so that `vmsim_free()` can unmap them.
+typedef struct {
+  vmsim_addr_t base;
+  size_t       size;
+} allocation_t;
+static allocation_t* allocations     = NULL;
+static uint64_t      num_allocations = 0;
+static uint64_t      max_allocations = 0;
+
+// The next never-used block number on the backing store, and blocks released for reuse.
+static int           next_block_number = 1;
+static unsigned int* free_blocks       = NULL;
+static uint64_t      num_free_blocks   = 0;
+static uint64_t      max_free_blocks   = 0;
+
+// The number of real frames, including the reserved ones, and the number that real memory may grow to hold.
+static uint64_t num_entries         = DEFAULT_REAL_MEMORY_SIZE / PAGESIZE;
+static uint64_t max_entries         = DEFAULT_REAL_MEMORY_SIZE / PAGESIZE;
+
+// The frame table:  everything known about each real frame, indexed by frame number, with each field in an array of its own so that
+// scans over one field are sequential.
+typedef struct {
+
+  // The page table entry that maps the frame (`NULL` if the frame is unused), and the _simulated_ base address of what it holds:
+  // a page, or for a page table, the range of pages that the table maps.  Together, these are the frame's reverse mapping.
+  pt_entry_t**  pte;
+  vmsim_addr_t* sim_page;
+
+  // The page table level of the frame's contents:  from 1 for the tables just below the upper one, through `pt_levels - 1` for the
+  // tables that map simulated pages, to `pt_levels` for a simulated page itself.
+  uint8_t*      level;
+
+  // For a page table, the number of its entries that are in use, and the number of those that are resident (plus any transient
+  // holds taken while a fault is being serviced).  A table with resident entries is never evicted.
+  uint32_t*     mapped;
+  uint32_t*     resident;
+
+  // The number of outstanding `vmsim_pin()` calls covering the frame.  A pinned frame is never evicted.
+  uint32_t*     pins;
+
+  // For a simulated page that was read back from the backing store, the block that still holds a copy of it (0 if none).  If the
+  // page is not dirtied before it is evicted again, it is not written again.
+  unsigned int* swap_slot;
+
+  // The clock's metadata:  dense bitmaps, 64 frames to a word, for scanning a word at a time.  A frame's bit in `referenced` copies
+  // the reference bit of the entry that maps it, and is set by the MMU along with that bit; a frame's bit in `evictable` is kept
+  // equal to `is_evictable()`, and is refreshed whenever anything that it depends upon changes.
+  uint64_t*     referenced;
+  uint64_t*     evictable;
+  uint64_t      num_words;
+
+  // NUMA migration's metadata:  a bitmap of the frames sampled since their last translation, and for each frame, the node of the
+  // thread that last translated it after it was sampled, or `NO_NODE` if none has since the frame was given its contents.
+  uint64_t*     sampled;
+  uint8_t*      last_node;
+
+  // Idle-page tracking's metadata:  a bitmap of the frames whose reference bits a scan has cleared, which the clock treats as
+  // referenced until it passes them; and for each simulated page, whether it was referenced before each of the last eight scans,
+  // the most recent in the high bit.
+  uint64_t*     young;
+  uint8_t*      history;
+
+  // Native mode's metadata:  a bitmap of the frames whose simulated pages are also present in a block from `vmsim_native_alloc()`,
+  // where the current contents of those that are dirty are to be found.
+  uint64_t*     windowed;
+
+} frame_table_t;
+static frame_table_t frames;
+
+// The current page number that we're pointing at (for the Clock Algorithm to go around).
+static uint64_t current_page_number = FIRST_POOL_FRAME;
+
+// Where to record the simulated page number of every translation, if anywhere.  Translations are not cached for the inline
+// accessors while recording, so that every access reaches the record.
+static FILE*        record_file     = NULL;
+
+// The paging activity counts.
+static vmsim_stats_t stats          = { 0 };
+
+// The simulated clock, in nanoseconds; what it read when the counts were last reset; and the time that each memory access takes,
+// to a frame on the accessing thread's own node and to one on another node.
+static uint64_t      sim_clock          = 0;
+static uint64_t      sim_clock_start    = 0;
+static uint64_t      mem_access_time    = DEFAULT_MEM_ACCESS_TIME;
+static uint64_t      remote_access_time = 0;
+
+// The lock serializing every call into the library, and the number of distinct threads that have called in.  Once there is more
+// than one, translations are no longer cached for the inline accessors, since another thread could evict a cached page.
+static pthread_mutex_t library_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread bool   thread_seen  = false;
+static unsigned int    num_threads  = 0;
+
+// The page-fault frequency monitor:  the accesses and the faults that evicted something in each bucket of its window; each thread's
+// such faults in each bucket and its kernel thread ID, indexed in the order that the threads called in; the bucket being filled,
+// and the number filled so far; and the thresholds.  Whenever the simulation starts or stops thrashing, the caller's function is
+// called once the library lock is released.
+static uint64_t             pff_accesses[PFF_BUCKETS];
+static uint64_t             pff_faults[PFF_BUCKETS];
+static uint64_t*            pff_thread_faults = NULL;
+static uint32_t*            thread_ids        = NULL;
+static __thread unsigned int thread_index     = 0;
+static unsigned int         pff_bucket        = 0;
+static unsigned int         pff_filled        = 0;
+static uint64_t             pff_bucket_size   = DEFAULT_PFF_WINDOW / PFF_BUCKETS;
+static uint64_t             pff_high          = DEFAULT_PFF_HIGH;
+static uint64_t             pff_low           = DEFAULT_PFF_HIGH / 2;
+static bool                 thrashing         = false;
+static bool                 thrashing_changed = false;
+static vmsim_thrashing_fn_t thrashing_fn      = NULL;
+static void*                thrashing_arg     = NULL;
+
+// Idle-page tracking:  the accesses between scans (0 if scans are only taken when asked for), the accesses until the next one, the
+// scans taken so far, and where to write the heatmap after each scan, if anywhere.  The heatmap is built in a buffer that grows
+// with the list of allocations.
+static uint64_t             idle_period       = 0;
+static uint64_t             idle_countdown    = 0;
+static uint64_t             idle_scans        = 0;
+static FILE*                heatmap_file      = NULL;
+static vmsim_region_heat_t* heatmap           = NULL;
+static uint64_t             heatmap_capacity  = 0;
+
+// The files mapped into the simulated space by `vmsim_map_file()` (a removed one has a size of 0):  for each, the simulated base of
+// the mapping and the bytes that it covers, the file and the offset within it at which the mapping starts, and whether the file
+// may be written.
+typedef struct {
+  vmsim_addr_t sim_base;
+  size_t       size;
+  int          fd;
+  uint64_t     offset;
+  bool         writable;
+} file_map_t;
+static file_map_t*          file_maps         = NULL;
+static uint64_t             num_file_maps     = 0;
+static uint64_t             max_file_maps     = 0;
+
+// Native mode:  the blocks of simulated space that are also mapped into host address space by `vmsim_native_alloc()` (a freed one
+// has a size of 0), the userfaultfd through which the host reports faults on them (-1 until the first block is made), and the
+// thread that services those faults.
+typedef struct {
+  vmsim_addr_t sim_base;
+  size_t       size;
+  uint8_t*     host;
+} native_block_t;
+static native_block_t*      natives           = NULL;
+static uint64_t             num_natives       = 0;
+static uint64_t             max_natives       = 0;
+static int                  native_fd         = -1;
+static pthread_t            native_thread;
+
+// Each thread's last translation, and the epoch that must match for it to be valid.  Cached translations start out invalid.
+__thread vmsim_tlb_t vmsim_tlb       = { 0, 0, NULL, 0, false, 0 };
+_Atomic uint64_t     vmsim_tlb_epoch = 1;
+
+// The frame of a cached translation, pinned between the caching thread's calls into the library so that no other thread can evict
+// or move it while it is used without the lock, and whether the calling thread holds that pin.  Translations are cached only while
+// a single thread has called in, so there is at most one such frame.
+static uint64_t      tlb_frame       = NULL_FRAME;
+static __thread bool tlb_pin_held    = false;
+
+// The start of a checkpoint:  the geometry that the rest depends upon, and the library's scalar state.  It is followed, each part
+// starting at a multiple of the page size, by the backing store's part (see `bs_checkpoint()`), and by real memory, page tables
+// and all, so that both can be mapped straight from the file.  The frame table and the allocators' lists come last.
+typedef struct {
+  char          magic[8];
+  uint32_t      version;
+  uint32_t      page_shift;
+  uint32_t      addr_size;
+  uint32_t      pt_levels;
+  uint32_t      num_nodes;
+  uint32_t      next_block_number;
+  uint64_t      num_entries;
+  uint64_t      max_entries;
+  uint64_t      file_size;
+  uint64_t      sim_free_addr;
+  uint64_t      num_allocations;
+  uint64_t      num_free_blocks;
+  uint64_t      current_page_number;
+  uint64_t      sample_hand;
+  uint64_t      sample_countdown;
+  uint64_t      sim_clock;
+  uint64_t      sim_clock_start;
+  vmsim_stats_t stats;
+} checkpoint_header_t;
+
+// Function declarations for Clock Algorithm and page swapping utilities
+static void  release_block     (unsigned int block_number);
+static void  refresh_evictable (uint64_t frame);
+static void  set_frame_bit     (uint64_t* map, uint64_t frame, bool value);
+static void  scan_idle         ();
+pt_entry_t*  find_lru      ();
+vmsim_addr_t from_mm_to_bs (pt_entry_t* entry_ptr);
+void         from_bs_to_mm (vmsim_addr_t entry_address, vmsim_addr_t real_address);
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Find the NUMA node to which a frame belongs.  The reserved frames belong to the first node.
+ *
+ * \param  frame The frame number.
+ * \return the node number.
+ */
+static unsigned int frame_node (uint64_t frame) {
+
+  if (frame < FIRST_POOL_FRAME) {
+    return 0;
+  }
+  return (frame - FIRST_POOL_FRAME) / frames_per_node;
+
+} // frame_node ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Fit the nodes to a size of real memory, which may leave the last ones with fewer frames, or none at all.  Frames beyond the end
+ * are dropped from the nodes' stacks of released frames.
+ *
+ * \param limit The number of frames in real memory, including the reserved ones.
+ */
+static void limit_nodes (uint64_t limit) {
+
+  for (unsigned int node = 0; node < num_nodes; node += 1) {
+    numa_node_t* n = &nodes[node];
+    n->end_frame = n->first_frame + frames_per_node;
+    if (n->end_frame > limit) {
+      n->end_frame = (n->first_frame > limit) ? n->first_frame : limit;
+    }
+    if (n->next_frame > n->end_frame) {
+      n->next_frame = n->end_frame;
+    }
+    uint64_t kept = 0;
+    for (uint64_t i = 0; i < n->num_free; i += 1) {
+      if (free_frames[n->first_frame + i] < n->end_frame) {
+        free_frames[n->first_frame + kept] = free_frames[n->first_frame + i];
+        kept += 1;
+      }
+    }
+    n->num_free = kept;
+  }
+
+} // limit_nodes ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Measure the page-fault frequency over the window.
+ *
+ * \param pff A pointer to a space into which to store the measurements.
+ */
+static void measure_pff (vmsim_pff_t* pff) {
+
+  pff->thrashing    = thrashing;
+  pff->accesses     = 0;
+  pff->faults       = 0;
+  pff->worst_thread = 0;
+  pff->worst_faults = 0;
+  for (unsigned int bucket = 0; bucket < PFF_BUCKETS; bucket += 1) {
+    pff->accesses += pff_accesses[bucket];
+    pff->faults   += pff_faults[bucket];
+  }
+  pff->fault_rate = (pff->accesses == 0) ? 0 : (pff->faults * 1000000) / pff->accesses;
+
+  for (unsigned int thread = 0; thread < num_threads; thread += 1) {
+    uint64_t faults = 0;
+    for (unsigned int bucket = 0; bucket < PFF_BUCKETS; bucket += 1) {
+      faults += pff_thread_faults[(thread * PFF_BUCKETS) + bucket];
+    }
+    if (faults > pff->worst_faults) {
+      pff->worst_thread = thread_ids[thread];
+      pff->worst_faults = faults;
+    }
+  }
+
+} // measure_pff ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Close the bucket being filled, judging from the whole window whether the simulation has started or stopped thrashing, and slide
+ * the window on to the next bucket.
+ */
+static void close_pff_bucket () {
+
+  if (thrashing) {
+    stats.thrash_accesses += pff_accesses[pff_bucket];
+  }
+
+  // Judge only full windows, and leave a gap between the two thresholds so that a rate near one does not flap.
+  if (pff_filled < PFF_BUCKETS) {
+    pff_filled += 1;
+  }
+  if (pff_filled == PFF_BUCKETS) {
+    vmsim_pff_t pff;
+    measure_pff(&pff);
+    if ((!thrashing && pff.fault_rate >= pff_high) || (thrashing && pff.fault_rate <= pff_low)) {
+      thrashing         = !thrashing;
+      thrashing_changed = true;
+      stats.thrash_episodes += thrashing;
+    }
+  }
+
+  pff_bucket = (pff_bucket + 1) % PFF_BUCKETS;
+  pff_accesses[pff_bucket] = 0;
+  pff_faults[pff_bucket]   = 0;
+  for (unsigned int thread = 0; thread < num_threads; thread += 1) {
+    pff_thread_faults[(thread * PFF_BUCKETS) + pff_bucket] = 0;
+  }
+
+} // close_pff_bucket ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Charge the calling thread's accesses to a frame to the simulated clock, counting them as local or remote.
+ *
+ * \param frame The frame number.
+ * \param count The number of accesses.
+ */
+static void charge_accesses (uint64_t frame, uint64_t count) {
+
+  if (frame_node(frame) == thread_node) {
+    stats.local_accesses += count;
+    sim_clock += count * mem_access_time;
+  } else {
+    stats.remote_accesses += count;
+    sim_clock += count * remote_access_time;
+  }
+
+  pff_accesses[pff_bucket] += count;
+  if (pff_accesses[pff_bucket] >= pff_bucket_size) {
+    close_pff_bucket();
+  }
+
+  if (idle_period > 0) {
+    if (idle_countdown <= count) {
+      idle_countdown = idle_period;
+      scan_idle();
+    } else {
+      idle_countdown -= count;
+    }
+  }
+
+} // charge_accesses ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Acquire the library lock, noting whether the calling thread is new, and collecting what its cached translation did meanwhile.
+ */
+static void lock_library () {
+
+  pthread_mutex_lock(&library_lock);
+  if (!thread_seen) {
+    thread_seen  = true;
+    thread_node  = num_threads % num_nodes;
+    thread_index = num_threads;
+    pff_thread_faults = realloc(pff_thread_faults, (num_threads + 1) * PFF_BUCKETS * sizeof(uint64_t));
+    thread_ids        = realloc(thread_ids, (num_threads + 1) * sizeof(uint32_t));
+    assert(pff_thread_faults != NULL && thread_ids != NULL);
+    memset(&pff_thread_faults[thread_index * PFF_BUCKETS], 0, PFF_BUCKETS * sizeof(uint64_t));
+    thread_ids[thread_index] = syscall(SYS_gettid);
+    num_threads += 1;
+    if (num_threads > 1) {
+      vmsim_tlb_epoch += 1;
+    }
+  }
+
+  // Charge the accesses that the thread's cached translation served since it last called in, all of which were to its frame, and
+  // unpin that frame, which the library may now evict or move like any other.
+  if (vmsim_tlb.hits > 0) {
+    charge_accesses(GET_FRAME((vmsim_addr_t) ((void*) vmsim_tlb.host_page - real_base)), vmsim_tlb.hits);
+    vmsim_tlb.hits = 0;
+  }
+  if (tlb_pin_held) {
+    tlb_pin_held = false;
+    if (tlb_frame != NULL_FRAME) {
+      frames.pins[tlb_frame] -= 1;
+      refresh_evictable(tlb_frame);
+      tlb_frame = NULL_FRAME;
+    }
+  }
+
+} // lock_library ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Release the library lock, pinning the frame of the calling thread's cached translation if it is still valid, and then report a
+ * change in thrashing to the caller's function, if there was one, so that the function may call into the library.
+ */
+static void unlock_library () {
+
+  vmsim_thrashing_fn_t fn = NULL;
+  vmsim_pff_t          pff;
+  if (thrashing_changed) {
+    thrashing_changed = false;
+    fn = thrashing_fn;
+    measure_pff(&pff);
+  }
+  void* arg = thrashing_arg;
+
+  // Pin the frame of the thread's cached translation, if it is still valid, before the thread goes on to use it without the lock.
+  if (num_threads == 1 && vmsim_tlb.host_page != NULL && vmsim_tlb.epoch == vmsim_tlb_epoch) {
+    tlb_frame    = GET_FRAME((vmsim_addr_t) ((void*) vmsim_tlb.host_page - real_base));
+    tlb_pin_held = true;
+    frames.pins[tlb_frame] += 1;
+    refresh_evictable(tlb_frame);
+  }
+  pthread_mutex_unlock(&library_lock);
+
+  if (fn != NULL) {
+    fn(&pff, arg);
+  }
+
+} // unlock_library ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Find the frame that holds a given page table entry.
+ *
+ * \param  entry_ptr A pointer to a page table entry within real memory.
+ * \return the frame number of the page table containing that entry.
+ */
+static uint64_t entry_frame (pt_entry_t* entry_ptr) {
+
+  return GET_FRAME((vmsim_addr_t) ((void*) entry_ptr - real_base));
+
+} // entry_frame ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Set or clear a frame's bit in one of the frame bitmaps.
+ *
+ * \param map   The bitmap.
+ * \param frame The frame number.
+ * \param value Whether the bit should be set.
+ */
+static void set_frame_bit (uint64_t* map, uint64_t frame, bool value) {
+
+  uint64_t mask = 1ULL << (frame & 63);
+  if (value) {
+    map[frame >> 6] |= mask;
+  } else {
+    map[frame >> 6] &= ~mask;
+  }
+
+} // set_frame_bit ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Change the number of resident entries (or holds) of a page table, keeping its evictability current.
+ *
+ * \param frame The frame number of the page table.
+ * \param delta The change, +1 or -1.
+ */
+static void adjust_resident (uint64_t frame, int delta) {
+
+  frames.resident[frame] += delta;
+  refresh_evictable(frame);
+
+} // adjust_resident ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Find the host address at which a block from `vmsim_native_alloc()` shows a simulated page.
+ *
+ * \param  sim_page The _simulated_ base address of the page.
+ * \return the host address, or `NULL` if the page lies in no such block.
+ */
+static uint8_t* native_host (vmsim_addr_t sim_page) {
+
+  for (uint64_t i = 0; i < num_natives; i += 1) {
+    if ((vmsim_addr_t) (sim_page - natives[i].sim_base) < natives[i].size) {
+      return natives[i].host + (vmsim_addr_t) (sim_page - natives[i].sim_base);
+    }
+  }
+  return NULL;
+
+} // native_host ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Determine whether a host buffer overlaps a block from `vmsim_native_alloc()`.  Such a buffer must not be touched while the
+ * library lock is held, since a fault on it can be serviced only by the native thread, which must take the lock to do so.
+ *
+ * \param  buffer The buffer.
+ * \param  size   The size of the buffer, in bytes.
+ * \return whether the buffer overlaps a native block.
+ */
+static bool in_native (const void* buffer, size_t size) {
+
+  for (uint64_t i = 0; i < num_natives; i += 1) {
+    if ((const uint8_t*) buffer < natives[i].host + natives[i].size && (const uint8_t*) buffer + size > natives[i].host) {
+      return true;
+    }
+  }
+  return false;
+
+} // in_native ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Take a simulated page back out of the native block in which it is present, if it is, so that its frame again holds its contents
+ * and its next access there faults.  A dirty page may have been written there, so it is write-protected before it is copied back,
+ * lest a write from another thread be lost; a clean one is unchanged, and is simply dropped.
+ *
+ * \param frame The frame that holds the page.
+ * \param keep  Whether the page's contents are still wanted.
+ */
+static void withdraw_native (uint64_t frame, bool keep) {
+
+  if ((frames.windowed[frame >> 6] & (1ULL << (frame & 63))) == 0) {
+    return;
+  }
+  uint8_t* host = native_host(frames.sim_page[frame]);
+  assert(host != NULL);
+  if (keep && IS_DIRTY(*frames.pte[frame])) {
+    struct uffdio_writeprotect protect;
+    protect.range.start = (uintptr_t) host;
+    protect.range.len   = PAGESIZE;
+    protect.mode        = UFFDIO_WRITEPROTECT_MODE_WP;
+    int protected = ioctl(native_fd, UFFDIO_WRITEPROTECT, &protect);
+    assert(protected == 0);
+    memcpy(real_base + (frame * PAGESIZE), host, PAGESIZE);
+  }
+  madvise(host, PAGESIZE, MADV_DONTNEED);
+  set_frame_bit(frames.windowed, frame, false);
+
+} // withdraw_native ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Sample the reference bits of native pages:  take those among a word of frames whose bits were just cleared back out of their
+ * blocks, so that their next accesses there fault, and set the bits again.
+ *
+ * \param word    The index of the word of frames.
+ * \param cleared The frames of the word whose reference bits were cleared.
+ */
+static void sample_native (uint64_t word, uint64_t cleared) {
+
+  uint64_t sampling = cleared & frames.windowed[word];
+  while (sampling != 0) {
+    uint64_t frame = (word << 6) + __builtin_ctzll(sampling);
+    sampling &= sampling - 1;
+    withdraw_native(frame, true);
+  }
+
+} // sample_native ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Find the mapped file in which a simulated address lies.
+ *
+ * \param  sim_addr The _simulated_ address.
+ * \return the mapping of the file, or `NULL` if the address lies in none.
+ */
+static file_map_t* mapped_file (vmsim_addr_t sim_addr) {
+
+  for (uint64_t i = 0; i < num_file_maps; i += 1) {
+    if ((vmsim_addr_t) (sim_addr - file_maps[i].sim_base) < file_maps[i].size) {
+      return &file_maps[i];
+    }
+  }
+  return NULL;
+
+} // mapped_file ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Determine whether any file is mapped, which a checkpoint cannot capture.
+ *
+ * \return whether a file is mapped.
+ */
+static bool files_mapped () {
+
+  for (uint64_t i = 0; i < num_file_maps; i += 1) {
+    if (file_maps[i].size > 0) {
+      return true;
+    }
+  }
+  return false;
+
+} // files_mapped ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Find the file that a resident frame's simulated page is to be written back to, or read from again, when it leaves real memory.
+ * A page written after being read from a file that may not be written has become private, and belongs to the backing store.
+ *
+ * \param  frame The frame number.
+ * \param  entry The page table entry that maps the frame.
+ * \return the mapping of the file, or `NULL` if the page is not backed by one.
+ */
+static file_map_t* file_backing (uint64_t frame, pt_entry_t entry) {
+
+  if (frames.level[frame] != pt_levels || frames.swap_slot[frame] != 0) {
+    return NULL;
+  }
+  file_map_t* map = mapped_file(frames.sim_page[frame]);
+  if (map == NULL || (!map->writable && IS_DIRTY(entry))) {
+    return NULL;
+  }
+  return map;
+
+} // file_backing ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Read a frame's simulated page from, or write it back to, the file in which it lies.
+ *
+ * \param frame The frame number.
+ * \param map   The mapping of the file.
+ * \param write Whether to write the page rather than read it.
+ */
+static void transfer_file_page (uint64_t frame, file_map_t* map, bool write) {
+
+  vmsim_addr_t position = frames.sim_page[frame] - map->sim_base;
+  size_t       size     = (map->size - position < PAGESIZE) ? map->size - position : PAGESIZE;
+  bool         done;
+  if (write) {
+    done = bs_file_write(frame * PAGESIZE, map->fd, map->offset + position, size);
+    stats.file_writes += 1;
+  } else {
+    done = bs_file_read(frame * PAGESIZE, map->fd, map->offset + position, size);
+    stats.file_reads += 1;
+  }
+  assert(done);
+
+} // transfer_file_page ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Take a frame from a node without evicting anything:  a released frame if there is one, and otherwise a never-used one.  Frames
+ * are not cleared when they are released, but the never-used frames at the end of each node hold zeros, as host memory that was
+ * never touched or was handed back, so only a released frame may need clearing before it is reused.
+ *
+ * \param  node   The node number.
+ * \param  frame  A pointer to a space into which to store the frame number.
+ * \param  zeroed A pointer to a space into which to store whether the frame is known to hold zeros, or `NULL`.
+ * \return whether the node had a frame to give.
+ */
+static bool take_node_frame (unsigned int node, uint64_t* frame, bool* zeroed) {
+
+  numa_node_t* n = &nodes[node];
+  if (n->num_free > 0) {
+    n->num_free -= 1;
+    *frame = free_frames[n->first_frame + n->num_free];
+    if (zeroed != NULL) {
+      *zeroed = false;
+    }
+    return true;
+  }
+  if (n->next_frame < n->end_frame) {
+    *frame = n->next_frame;
+    n->next_frame += 1;
+    if (zeroed != NULL) {
+      *zeroed = true;
+    }
+    return true;
+  }
+  return false;
+
+} // take_node_frame ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Allocate a page of real memory space from the general pool, for either a page table or a simulated page.  Previously released
+ * frames are preferred, then never-used ones, from the preferred node first and then from the others in turn; if there are none, a
+ * page is evicted to the backing store to make room.
+ *
+ * \param  node   The preferred NUMA node.
+ * \param  zeroed A pointer to a space into which to store whether the page is known to hold zeros.  A page that does not may hold
+ *                anything, and must be cleared by a caller that needs it clear.
+ * \return The _real_ base address of a page of memory.
+ */
+static vmsim_addr_t allocate_real_page (unsigned int node, bool* zeroed) {
+
+  // Reuse a released frame, or take a never-used one, if there is one.
+  for (unsigned int i = 0; i < num_nodes; i += 1) {
+    uint64_t frame;
+    if (take_node_frame((node + i) % num_nodes, &frame, zeroed)) {
+      return frame * PAGESIZE;
+    }
+  }
+
+  /** We are out of main memory space, so we have to swap some pages.  Find the least-recently used entry. */
+  pt_entry_t* entry = find_lru();
+
+  /** Move the contents of that entry to the backing store, and get the
+   *  address of the page we just freed, which still holds them. */
+  vmsim_addr_t address = from_mm_to_bs(entry);
+  *zeroed = false;
+
+  /** Return the newly-freed page address. */
+  return address;
+
+} // allocate_real_page ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Return a frame to the general pool.
+ *
+ * \param real_addr The _real_ base address of the frame to release.
+ */
+static void release_real_page (vmsim_addr_t real_addr) {
+
+  uint64_t frame = GET_FRAME(real_addr);
+  assert(frames.pins[frame] == 0);
+  withdraw_native(frame, false);
+  frames.pte[frame] = NULL;
+  set_frame_bit(frames.referenced, frame, false);
+  set_frame_bit(frames.evictable, frame, false);
+  set_frame_bit(frames.young, frame, false);
+  if (frames.swap_slot[frame] != 0) {
+    release_block(frames.swap_slot[frame]);
+    frames.swap_slot[frame] = 0;
+  }
+  vmsim_tlb_epoch += 1;
+  numa_node_t* node = &nodes[frame_node(frame)];
+  free_frames[node->first_frame + node->num_free] = frame;
+  node->num_free += 1;
+
+} // release_real_page ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Allocate a block on the backing store, reusing a released one if possible.
+ *
+ * \return the block number.
+ */
+static unsigned int allocate_block () {
+
+  if (num_free_blocks > 0) {
+    num_free_blocks -= 1;
+    return free_blocks[num_free_blocks];
+  }
+  unsigned int block_number = next_block_number;
+  next_block_number = next_block_number + 1;
+  return block_number;
+
+} // allocate_block ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Release a backing store block whose contents are no longer needed.
+ *
+ * \param block_number The block to release.
+ */
+static void release_block (unsigned int block_number) {
+
+  bs_release(block_number);
+  if (num_free_blocks == max_free_blocks) {
+    max_free_blocks = (max_free_blocks == 0) ? 1024 : max_free_blocks * 2;
+    free_blocks = realloc(free_blocks, max_free_blocks * sizeof(unsigned int));
+    assert(free_blocks != NULL);
+  }
+  free_blocks[num_free_blocks] = block_number;
+  num_free_blocks += 1;
+
+} // release_block ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Set up the real space, the page tables, and the supporting components.  This runs when the library is loaded, so that the access
+ * path need not check for it.
+ */
+void __attribute__ ((constructor)) vmsim_init () {
+
+  // Only initialize if it hasn't already happened.
+  if (real_base == NULL) {
+
+    // Determine the real memory size, preferrably by environment variable, otherwise use the default.
+    char* real_size_envvar = getenv("VMSIM_REAL_MEM_SIZE");
+    if (real_size_envvar != NULL) {
+      errno = 0;
+      real_size = strtoul(real_size_envvar, NULL, 10);
+      assert(errno == 0);
+    }
+
+    // Determine the page table depth, which only the 64-bit space may choose.
+    char* pt_levels_envvar = getenv("VMSIM_PT_LEVELS");
+    if (pt_levels_envvar != NULL) {
+      pt_levels = atoi(pt_levels_envvar);
+    }
+    assert(pt_levels >= 2 && pt_levels <= MAX_PT_LEVELS);
+    assert(real_size >= (FIRST_POOL_FRAME + 2 * pt_levels) * PAGESIZE);
+
+    // Determine how far real memory may grow, which by default is not at all.
+    max_real_size = real_size;
+    char* max_real_size_envvar = getenv("VMSIM_REAL_MEM_MAX");
+    if (max_real_size_envvar != NULL) {
+      errno = 0;
+      max_real_size = strtoull(max_real_size_envvar, NULL, 10);
+      assert(errno == 0);
+    }
+    assert(max_real_size >= real_size);
+
+    // Determine the simulated time of a memory access.
+    char* mem_access_envvar = getenv("VMSIM_MEM_ACCESS_NS");
+    if (mem_access_envvar != NULL) {
+      errno = 0;
+      mem_access_time = strtoull(mem_access_envvar, NULL, 10);
+      assert(errno == 0);
+    }
+
+    // Determine the NUMA layout and policies.  Remote accesses take twice as long as local ones unless told otherwise.
+    char* numa_nodes_envvar = getenv("VMSIM_NUMA_NODES");
+    if (numa_nodes_envvar != NULL) {
+      num_nodes = atoi(numa_nodes_envvar);
+    }
+    assert(num_nodes >= 1 && num_nodes <= UINT8_MAX);
+    char* numa_policy_envvar = getenv("VMSIM_NUMA_POLICY");
+    if (numa_policy_envvar != NULL) {
+      interleave = (strcmp(numa_policy_envvar, "interleave") == 0);
+      assert(interleave || strcmp(numa_policy_envvar, "first-touch") == 0);
+    }
+    char* numa_migrate_envvar = getenv("VMSIM_NUMA_MIGRATE");
+    if (numa_migrate_envvar != NULL) {
+      migrate = (atoi(numa_migrate_envvar) != 0);
+    }
+    remote_access_time = 2 * mem_access_time;
+    char* remote_access_envvar = getenv("VMSIM_NUMA_REMOTE_NS");
+    if (remote_access_envvar != NULL) {
+      errno = 0;
+      remote_access_time = strtoull(remote_access_envvar, NULL, 10);
+      assert(errno == 0);
+    }
+
+    // Determine the page-fault frequency monitor's window and thresholds.
+    char* pff_window_envvar = getenv("VMSIM_PFF_WINDOW");
+    if (pff_window_envvar != NULL) {
+      errno = 0;
+      pff_bucket_size = strtoull(pff_window_envvar, NULL, 10) / PFF_BUCKETS;
+      assert(errno == 0 && pff_bucket_size > 0);
+    }
+    char* pff_high_envvar = getenv("VMSIM_PFF_HIGH");
+    if (pff_high_envvar != NULL) {
+      errno = 0;
+      pff_high = strtoull(pff_high_envvar, NULL, 10);
+      assert(errno == 0);
+      pff_low  = pff_high / 2;
+    }
+    char* pff_low_envvar = getenv("VMSIM_PFF_LOW");
+    if (pff_low_envvar != NULL) {
+      errno = 0;
+      pff_low = strtoull(pff_low_envvar, NULL, 10);
+      assert(errno == 0);
+    }
+    assert(pff_low <= pff_high);
+
+    // Determine how often to scan for idle pages, and open the heatmap, if one is requested.
+    char* idle_scan_envvar = getenv("VMSIM_IDLE_SCAN");
+    if (idle_scan_envvar != NULL) {
+      errno = 0;
+      idle_period = strtoull(idle_scan_envvar, NULL, 10);
+      assert(errno == 0);
+      idle_countdown = idle_period;
+    }
+    char* heatmap_envvar = getenv("VMSIM_HEATMAP");
+    if (heatmap_envvar != NULL) {
+      heatmap_file = fopen(heatmap_envvar, "w");
+      if (heatmap_file == NULL) {
+        fprintf(stderr, "ERROR:\tvmsim_init():\tCannot open heatmap %s\n", heatmap_envvar);
+        abort();
+      }
+      fprintf(heatmap_file, "scan,sim_ns,base,size,resident");
+      for (unsigned int heat = 0; heat < VMSIM_HEAT_LEVELS; heat += 1) {
+        fprintf(heatmap_file, ",heat_%u", heat);
+      }
+      fprintf(heatmap_file, ",working_set\n");
+    }
+
+    // Determine whether lower page tables may be evicted.
+    char* pageable_pts_envvar = getenv("VMSIM_PAGEABLE_PT");
+    pageable_pts = (pageable_pts_envvar != NULL && atoi(pageable_pts_envvar) != 0);
+
+    // Map the real storage space, reserving room for it to grow in place, backed as `VMSIM_HOST_PAGES` asks (see `host.h`).  Host
+    // memory is committed only as frames are used.
+    real_base = host_map(max_real_size, &real_hugetlb);
+    real_limit = (void*)((intptr_t)real_base + real_size);
+
+    // Initialize the per-frame bookkeeping, for as many frames as real memory may grow to hold.
+    num_entries       = real_size / PAGESIZE;
+    max_entries       = max_real_size / PAGESIZE;
+    frames.pte        = calloc(max_entries, sizeof(pt_entry_t*));
+    frames.sim_page   = calloc(max_entries, sizeof(vmsim_addr_t));
+    frames.level      = calloc(max_entries, sizeof(uint8_t));
+    frames.mapped     = calloc(max_entries, sizeof(uint32_t));
+    frames.resident   = calloc(max_entries, sizeof(uint32_t));
+    frames.pins       = calloc(max_entries, sizeof(uint32_t));
+    frames.swap_slot  = calloc(max_entries, sizeof(unsigned int));
+    frames.num_words  = (max_entries + 63) / 64;
+    frames.referenced = calloc(frames.num_words, sizeof(uint64_t));
+    frames.evictable  = calloc(frames.num_words, sizeof(uint64_t));
+    frames.sampled    = calloc(frames.num_words, sizeof(uint64_t));
+    frames.last_node  = calloc(max_entries, sizeof(uint8_t));
+    frames.young      = calloc(frames.num_words, sizeof(uint64_t));
+    frames.history    = calloc(max_entries, sizeof(uint8_t));
+    frames.windowed   = calloc(frames.num_words, sizeof(uint64_t));
+    free_frames       = calloc(max_entries, sizeof(uint64_t));
+    assert(frames.pte != NULL && frames.sim_page != NULL && frames.level != NULL && frames.mapped != NULL &&
+           frames.resident != NULL && frames.pins != NULL && frames.swap_slot != NULL && frames.referenced != NULL &&
+           frames.evictable != NULL && frames.sampled != NULL && frames.last_node != NULL && frames.young != NULL &&
+           frames.history != NULL && frames.windowed != NULL && free_frames != NULL);
+
+    // Divide the pool, at its largest, among the nodes.
+    uint64_t pool_frames = max_entries - FIRST_POOL_FRAME;
+    assert(num_nodes <= num_entries - FIRST_POOL_FRAME);
+    frames_per_node = (pool_frames + num_nodes - 1) / num_nodes;
+    nodes = calloc(num_nodes, sizeof(numa_node_t));
+    assert(nodes != NULL);
+    for (unsigned int node = 0; node < num_nodes; node += 1) {
+      nodes[node].first_frame = FIRST_POOL_FRAME + (node * frames_per_node);
+      nodes[node].next_frame  = nodes[node].first_frame;
+    }
+    limit_nodes(num_entries);
+
+    // The upper table has a fixed frame of its own, outside of the pool.
+    upper_pt = UPPER_PT_FRAME * PAGESIZE;
+
+    // Initialize the simualted space allocator.  Leave page 0 unused, start at page 1.
+    sim_free_addr = PAGESIZE;
+
+    // Open the reference record, if one is requested.
+    char* record_envvar = getenv("VMSIM_RECORD");
+    if (record_envvar != NULL) {
+      record_file = fopen(record_envvar, "w");
+      if (record_file == NULL) {
+        fprintf(stderr, "ERROR:\tvmsim_init():\tCannot open reference record %s\n", record_envvar);
+        abort();
+      }
+    }
+
+    // Initialize the supporting components.
+    mmu_init(upper_pt, pt_levels, frames.referenced);
+    bs_init(&sim_clock, &stats);
+    trace_init();
+
+  }
+
+} // vmsim_init ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Flush the mapped files, the reference record and the event trace, if there are any, when the library is unloaded.
+ */
+static void __attribute__ ((destructor)) vmsim_fini () {
+
+  // Write the dirty pages of mapped files back, as removing the mappings would.
+  for (uint64_t frame = FIRST_POOL_FRAME; frame < num_entries; frame += 1) {
+    if (frames.pte[frame] != NULL && IS_DIRTY(*frames.pte[frame])) {
+      file_map_t* map = file_backing(frame, *frames.pte[frame]);
+      if (map != NULL) {
+        transfer_file_page(frame, map, true);
+      }
+    }
+  }
+
+  trace_fini();
+
+  if (record_file != NULL) {
+    fclose(record_file);
+    record_file = NULL;
+  }
+
+  if (heatmap_file != NULL) {
+    fclose(heatmap_file);
+    heatmap_file = NULL;
+  }
+
+} // vmsim_fini ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Move the contents of a frame, a simulated page or a page table, to a free one, leaving the old frame unused.
+ *
+ * \param frame     The frame to empty.
+ * \param new_frame The free frame to fill.
+ */
+static void move_frame (uint64_t frame, uint64_t new_frame) {
+
+  // Copy the contents, point the entry that maps them at the new frame, and carry their bookkeeping over.
+  memcpy(real_base + (new_frame * PAGESIZE), real_base + (frame * PAGESIZE), PAGESIZE);
+  pt_entry_t* entry_ptr = frames.pte[frame];
+  *entry_ptr = (*entry_ptr & FLAG_MASK) | (new_frame * PAGESIZE);
+  frames.pte[new_frame]       = entry_ptr;
+  frames.sim_page[new_frame]  = frames.sim_page[frame];
+  frames.level[new_frame]     = frames.level[frame];
+  frames.mapped[new_frame]    = frames.mapped[frame];
+  frames.resident[new_frame]  = frames.resident[frame];
+  frames.swap_slot[new_frame] = frames.swap_slot[frame];
+  frames.last_node[new_frame] = frames.last_node[frame];
+  frames.history[new_frame]   = frames.history[frame];
+  frames.pte[frame]           = NULL;
+  frames.swap_slot[frame]     = 0;
+  set_frame_bit(frames.referenced, new_frame, IS_REFERENCED(*entry_ptr));
+  set_frame_bit(frames.young, new_frame, (frames.young[frame >> 6] >> (frame & 63)) & 1);
+  set_frame_bit(frames.windowed, new_frame, (frames.windowed[frame >> 6] >> (frame & 63)) & 1);
+  set_frame_bit(frames.referenced, frame, false);
+  set_frame_bit(frames.evictable, frame, false);
+  set_frame_bit(frames.young, frame, false);
+  set_frame_bit(frames.windowed, frame, false);
+  refresh_evictable(new_frame);
+
+  // The resident contents of a page table must learn where their entries now are, and the MMU must forget where it was.
+  if (frames.level[new_frame] < pt_levels) {
+    pt_entry_t* table = (pt_entry_t*) (real_base + (new_frame * PAGESIZE));
+    for (uint64_t i = 0; i < PAGESIZE / sizeof(pt_entry_t); i += 1) {
+      if (IS_RESIDENT(table[i])) {
+        frames.pte[GET_FRAME(GET_PAGE_ADDR(table[i]))] = &table[i];
+      }
+    }
+    mmu_flush_walk_cache();
+  }
+  vmsim_tlb_epoch += 1;
+
+} // move_frame ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Find a frame on a node whose contents could be evicted, and which was not referenced since the clock or an idle-page scan last
+ * cleared its bit.
+ *
+ * \param  node  The node number.
+ * \param  frame A pointer to a space into which to store the frame number.
+ * \return whether the node has such a frame.
+ */
+static bool find_cold_frame (unsigned int node, uint64_t* frame) {
+
+  numa_node_t* n = &nodes[node];
+  if (n->first_frame >= n->next_frame) {
+    return false;
+  }
+  uint64_t last = n->next_frame - 1;
+  for (uint64_t word = n->first_frame >> 6; word <= last >> 6; word += 1) {
+    uint64_t cold = frames.evictable[word] & ~(frames.referenced[word] | frames.young[word]);
+    if (word == n->first_frame >> 6) {
+      cold &= ~0ULL << (n->first_frame & 63);
+    }
+    if (word == last >> 6) {
+      cold &= ~0ULL >> (63 - (last & 63));
+    }
+    if (cold != 0) {
+      *frame = (word << 6) + __builtin_ctzll(cold);
+      return true;
+    }
+  }
+  return false;
+
+} // find_cold_frame ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Move a resident simulated page to another node:  to a free frame there if there is one, and otherwise to the frame of a cold
+ * page there, which is evicted to make room.
+ *
+ * \param  frame The frame that holds the page.
+ * \param  node  The node to which to move it.
+ * \return the frame that now holds the page.
+ */
+static uint64_t migrate_page (uint64_t frame, unsigned int node) {
+
+  uint64_t new_frame;
+  if (!take_node_frame(node, &new_frame, NULL)) {
+    if (!find_cold_frame(node, &new_frame)) {
+      return frame;
+    }
+    TRACE(TRACE_VICTIM, frames.sim_page[new_frame], new_frame);
+    new_frame = GET_FRAME(from_mm_to_bs(frames.pte[new_frame]));
+  }
+  move_frame(frame, new_frame);
+  release_real_page(frame * PAGESIZE);
+  stats.migrations += 1;
+  return new_frame;
+
+} // migrate_page ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Take the NUMA balancing step for a translation.  Every so often, a run of frames holding simulated pages is sampled, and cached
+ * translations are invalidated so that the next access to each sampled page comes here.  A sampled page that is translated twice
+ * in a row by threads on the same remote node is migrated to that node.
+ *
+ * \param  real_addr The _real_ address to which a simulated address was just translated.
+ * \return the _real_ address to use, which differs if the page was migrated.
+ */
+static vmsim_addr_t numa_balance (vmsim_addr_t real_addr) {
+
+  // Take the next sample, if it is time.
+  sample_countdown -= 1;
+  if (sample_countdown == 0) {
+    sample_countdown = NUMA_SAMPLE_PERIOD;
+    for (uint64_t i = 0; i < NUMA_SAMPLE_SIZE; i += 1) {
+      if (frames.pte[sample_hand] != NULL && frames.level[sample_hand] == pt_levels && frames.pins[sample_hand] == 0) {
+        set_frame_bit(frames.sampled, sample_hand, true);
+      }
+      sample_hand = (sample_hand + 1 < num_entries) ? sample_hand + 1 : FIRST_POOL_FRAME;
+    }
+    vmsim_tlb_epoch += 1;
+  }
+
+  // Note which node uses a sampled page, and migrate it if it was the same remote node the last time too.
+  uint64_t frame = GET_FRAME(real_addr);
+  if ((frames.sampled[frame >> 6] & (1ULL << (frame & 63))) == 0) {
+    return real_addr;
+  }
+  set_frame_bit(frames.sampled, frame, false);
+  if (frame_node(frame) != thread_node && frames.last_node[frame] == thread_node && frames.pins[frame] == 0) {
+    frame = migrate_page(frame, thread_node);
+  }
+  frames.last_node[frame] = thread_node;
+  return (frame * PAGESIZE) | GET_OFFSET(real_addr);
+
+} // numa_balance ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Find the allocation to which a simulated page belongs:  the last one that begins before the page ends, if it reaches into the
+ * page.
+ *
+ * \param  sim_page The _simulated_ base address of the page.
+ * \return the index of the allocation, or `num_allocations` if there is none.
+ */
+static uint64_t find_allocation (vmsim_addr_t sim_page) {
+
+  uint64_t low  = 0;
+  uint64_t high = num_allocations;
+  while (low < high) {
+    uint64_t middle = (low + high) / 2;
+    if (allocations[middle].base < (uint64_t) sim_page + PAGESIZE) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == 0 || allocations[low - 1].base + allocations[low - 1].size <= sim_page) {
+    return num_allocations;
+  }
+  return low - 1;
+
+} // find_allocation ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Build the heatmap of the allocations from the resident pages' histories, into `heatmap`.
+ */
+static void build_heatmap () {
+
+  if (heatmap_capacity < num_allocations) {
+    heatmap_capacity = max_allocations;
+    heatmap = realloc(heatmap, heatmap_capacity * sizeof(vmsim_region_heat_t));
+    assert(heatmap != NULL);
+  }
+  memset(heatmap, 0, num_allocations * sizeof(vmsim_region_heat_t));
+  for (uint64_t i = 0; i < num_allocations; i += 1) {
+    heatmap[i].base = allocations[i].base;
+    heatmap[i].size = allocations[i].size;
+  }
+
+  for (uint64_t frame = FIRST_POOL_FRAME; frame < num_entries; frame += 1) {
+    if (frames.pte[frame] == NULL || frames.level[frame] != pt_levels) {
+      continue;
+    }
+    uint64_t region = find_allocation(frames.sim_page[frame]);
+    if (region == num_allocations) {
+      continue;
+    }
+    heatmap[region].resident += 1;
+    heatmap[region].heat[__builtin_popcount(frames.history[frame])] += 1;
+    if (frames.history[frame] != 0) {
+      heatmap[region].working_set += PAGESIZE;
+    }
+  }
+
+} // build_heatmap ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Take a scan for idle pages:  shift each resident simulated page's reference bit into its history, and clear the bit so that the
+ * next scan sees only newer references.  The clock is not robbed of the bits, since each cleared one is kept in `frames.young`
+ * until the clock passes it; and cached translations are invalidated, so that the next access to each page sets its bit again.
+ */
+static void scan_idle () {
+
+  for (uint64_t frame = FIRST_POOL_FRAME; frame < num_entries; frame += 1) {
+    if (frames.pte[frame] == NULL || frames.level[frame] != pt_levels) {
+      continue;
+    }
+    bool referenced = IS_REFERENCED(*frames.pte[frame]);
+    frames.history[frame] = (frames.history[frame] >> 1) | (referenced ? 0x80 : 0);
+    if (referenced) {
+      CLEAR_REFERENCED(*frames.pte[frame]);
+      set_frame_bit(frames.referenced, frame, false);
+      set_frame_bit(frames.young, frame, true);
+      withdraw_native(frame, true);
+    }
+  }
+  idle_scans += 1;
+  vmsim_tlb_epoch += 1;
+
+  // Append each live allocation's row to the heatmap.
+  if (heatmap_file != NULL) {
+    build_heatmap();
+    for (uint64_t i = 0; i < num_allocations; i += 1) {
+      if (heatmap[i].size == 0) {
+        continue;
+      }
+      fprintf(heatmap_file, "%lu,%lu,%lu,%lu,%lu", (unsigned long) idle_scans, (unsigned long) sim_clock,
+              (unsigned long) heatmap[i].base, (unsigned long) heatmap[i].size, (unsigned long) heatmap[i].resident);
+      for (unsigned int heat = 0; heat < VMSIM_HEAT_LEVELS; heat += 1) {
+        fprintf(heatmap_file, ",%lu", (unsigned long) heatmap[i].heat[heat]);
+      }
+      fprintf(heatmap_file, ",%lu\n", (unsigned long) heatmap[i].working_set);
+    }
+  }
+
+} // scan_idle ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Map a _simulated_ address to a _real_ one.
+ *
+ * \param  sim_addr        The _simulated_ address to translate.
+ * \param  write_operation Whether the memory access is to _read_ (`false`) or to _write_ (`true`).
+ * \return the translated _real_ address.
+ */
+vmsim_addr_t vmsim_map (vmsim_addr_t sim_addr, bool write_operation) {
+
+  if (record_file != NULL) {
+    uint64_t page_number = sim_addr >> PAGE_SHIFT;
+    fwrite(&page_number, sizeof(page_number), 1, record_file);
+  }
+  vmsim_addr_t real_addr = mmu_translate(sim_addr, write_operation);
+  withdraw_native(GET_FRAME(real_addr), true);
+  if (num_nodes > 1 && migrate) {
+    real_addr = numa_balance(real_addr);
+  }
+  charge_accesses(GET_FRAME(real_addr), 1);
+  return real_addr;
+
+} // vmsim_map ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+vmsim_addr_t vmsim_map_fault (vmsim_addr_t entry_address, unsigned int level) {
+
+  pt_entry_t* entry_ptr    = (pt_entry_t*) (real_base + entry_address);
+  uint64_t    parent_frame = GET_FRAME(entry_address);
+
+  // Already there?  Nothing to do.
+  if (IS_RESIDENT(*entry_ptr)) {
+    return GET_PAGE_ADDR(*entry_ptr);
+  }
+  stats.faults += 1;
+
+  // Find the simulated range that the frame will hold:  the entry's share of the range that its table maps.
+  uint64_t     index    = (entry_address & OFFSET_MASK) / sizeof(pt_entry_t);
+  vmsim_addr_t sim_page = frames.sim_page[parent_frame] + ((index << (INDEX_BITS * (pt_levels - level))) << PAGE_SHIFT);
+  TRACE(TRACE_FAULT_BEGIN, sim_page, level);
+
+  // Get a frame first, since doing so may evict other pages and update their entries.  Hold the table containing the entry while
+  // doing so; its own ancestors are safe, since each has a resident table beneath it.
+  adjust_resident(parent_frame, +1);
+  unsigned int node      = thread_node;
+  if (interleave && level == pt_levels) {
+    node = (sim_page >> PAGE_SHIFT) % num_nodes;
+  }
+  bool         zeroed;
+  uint64_t     evictions = stats.evictions;
+  vmsim_addr_t real_addr = allocate_real_page(node, &zeroed);
+  uint64_t     frame     = GET_FRAME(real_addr);
+  adjust_resident(parent_frame, -1);
+
+  // Only a fault that had to evict something counts toward thrashing; one that found a free frame shows only that real memory is
+  // still filling up.
+  if (stats.evictions != evictions) {
+    pff_faults[pff_bucket] += 1;
+    pff_thread_faults[(thread_index * PFF_BUCKETS) + pff_bucket] += 1;
+  }
+  frames.level[frame]     = level;
+  frames.sim_page[frame]  = sim_page;
+  frames.history[frame]   = 0;
+  frames.last_node[frame] = NO_NODE;
+
+  if (*entry_ptr == 0 || *entry_ptr == PTE_FILE_BIT) {
+
+    // A brand new page, whose frame is cleared unless it is known to hold zeros already, or a page of a mapped file, which is read
+    // into it:  just point the entry at it.  An entry that held a page of a file was already counted as in use.
+    bool fresh = (*entry_ptr == 0);
+    frames.pte[frame] = entry_ptr;
+    file_map_t* map   = file_backing(frame, 0);
+    if (map != NULL) {
+      transfer_file_page(frame, map, false);
+    } else if (!zeroed) {
+      memset(real_base + real_addr, 0, PAGESIZE);
+    }
+    pt_entry_t entry = real_addr;
+    SET_RESIDENT(entry);
+    vmsim_write_real(&entry, entry_address, sizeof(entry));
+    frames.mapped[parent_frame] += fresh;
+    adjust_resident(parent_frame, +1);
+    frames.mapped[frame] = 0;
+    frames.resident[frame] = 0;
+    refresh_evictable(frame);
+
+  } else {
+
+    // A page that was evicted:  bring its contents back.
+    from_bs_to_mm(entry_address, real_addr);
+
+  }
+
+  TRACE(TRACE_FAULT_END, sim_page, frame);
+  return real_addr;
+
+} // vmsim_map_fault ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Remove the mapping for a simulated page, if there is one, releasing its frame or backing store block.  A lower page table left
+ * with no mappings is released as well.  A pinned page is left mapped.
+ *
+ * \param  sim_addr The _simulated_ base address of the page to unmap.
+ * \return whether the page is now unmapped.
+ */
+static bool unmap_page (vmsim_addr_t sim_addr) {
+
+  // Walk down to the table that maps the page, making (and holding) each table resident so that it can be edited.
+  vmsim_addr_t tables[MAX_PT_LEVELS];
+  vmsim_addr_t pte_addrs[MAX_PT_LEVELS];
+  unsigned int depth = 0;
+  tables[0] = upper_pt;
+  while (true) {
+    vmsim_addr_t index = GET_INDEX(sim_addr, pt_levels - 1 - depth);
+    pte_addrs[depth] = tables[depth] + (index * sizeof(pt_entry_t));
+    pt_entry_t pte;
+    vmsim_read_real(&pte, pte_addrs[depth], sizeof(pte));
+    if (pte == 0 || depth == pt_levels - 1) {
+      break;
+    }
+    depth += 1;
+    tables[depth] = vmsim_map_fault(pte_addrs[depth - 1], depth);
+    adjust_resident(GET_FRAME(tables[depth]), +1);
+  }
+
+  // Remove the page's own mapping, if it got that far.
+  bool unmapped = true;
+  if (depth == pt_levels - 1) {
+
+    uint64_t   table_frame = GET_FRAME(tables[depth]);
+    pt_entry_t pte;
+    vmsim_read_real(&pte, pte_addrs[depth], sizeof(pte));
+    if (IS_RESIDENT(pte) && frames.pins[GET_FRAME(pte)] > 0) {
+      unmapped = false;
+    } else if (pte != 0) {
+      if (IS_RESIDENT(pte)) {
+        file_map_t* map = file_backing(GET_FRAME(pte), pte);
+        if (map != NULL && IS_DIRTY(pte)) {
+          transfer_file_page(GET_FRAME(pte), map, true);
+        }
+        release_real_page(GET_PAGE_ADDR(pte));
+        adjust_resident(table_frame, -1);
+      } else if (GET_BLOCK(pte) != 0) {
+        release_block(GET_BLOCK(pte));
+      }
+      pte = 0;
+      vmsim_write_real(&pte, pte_addrs[depth], sizeof(pte));
+      frames.mapped[table_frame] -= 1;
+    }
+
+  }
+
+  // Going back up, release the holds, and return any table left empty to the pool.
+  for (; depth > 0; depth -= 1) {
+    uint64_t table_frame = GET_FRAME(tables[depth]);
+    adjust_resident(table_frame, -1);
+    if (frames.mapped[table_frame] == 0 && frames.resident[table_frame] == 0) {
+      release_real_page(tables[depth]);
+      mmu_flush_walk_cache();
+      pt_entry_t pte = 0;
+      vmsim_write_real(&pte, pte_addrs[depth - 1], sizeof(pte));
+      uint64_t parent_frame = GET_FRAME(tables[depth - 1]);
+      frames.mapped[parent_frame] -= 1;
+      adjust_resident(parent_frame, -1);
+    }
+  }
+  return unmapped;
+
+} // unmap_page ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void vmsim_read_real (void* buffer, vmsim_addr_t real_addr, size_t size) {
+
+  // Get a pointer into the real space and check the bounds.
+  void* ptr = real_base + real_addr;
+  void* end = (void*) ((intptr_t) ptr + size);
+  assert(end <= real_limit);
+
+  // Copy the requested bytes from the real space.
+  memcpy(buffer, ptr, size);
+
+} // vmsim_read_real ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void vmsim_write_real (void* buffer, vmsim_addr_t real_addr, size_t size) {
+
+  // Get a pointer into the real space and check the bounds.
+  void* ptr = real_base + real_addr;
+  void* end = (void*) ((intptr_t) ptr + size);
+  assert(end <= real_limit);
+
+  // Copy the requested bytes into the real space.
+  memcpy(ptr, buffer, size);
+
+} // vmsim_write_real ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Remember a translation as the calling thread's last one, for use by the inline accessors in `vmsim.h`.
+ *
+ * \param sim_addr        The _simulated_ address that was translated.
+ * \param real_addr       The _real_ address to which it translated.
+ * \param write_operation Whether the translation was for a write.
+ */
+static void fill_tlb (vmsim_addr_t sim_addr, vmsim_addr_t real_addr, bool write_operation) {
+
+  if (num_threads > 1 || record_file != NULL) {
+    return;
+  }
+
+  vmsim_addr_t page      = GET_PAGE_ADDR(sim_addr);
+  bool         same_page = (vmsim_tlb.epoch == vmsim_tlb_epoch && vmsim_tlb.page == page);
+
+  vmsim_tlb.writable  = write_operation || (same_page && vmsim_tlb.writable);
+  vmsim_tlb.page      = page;
+  vmsim_tlb.page_size = PAGESIZE;
+  vmsim_tlb.host_page = (uint8_t*) (real_base + GET_PAGE_ADDR(real_addr));
+  vmsim_tlb.epoch     = vmsim_tlb_epoch;
+
+} // fill_tlb ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void vmsim_read (void* buffer, vmsim_addr_t addr, size_t size) {
+
+  lock_library();
+  vmsim_addr_t real_addr = vmsim_map(addr, false);
+
+  // A buffer in a native block is filled from a copy once the library is unlocked, since filling it may fault.
+  if (in_native(buffer, size)) {
+    uint8_t bounce[PAGESIZE];
+    assert(size <= PAGESIZE);
+    vmsim_read_real(bounce, real_addr, size);
+    fill_tlb(addr, real_addr, false);
+    unlock_library();
+    memcpy(buffer, bounce, size);
+    return;
+  }
+
+  vmsim_read_real(buffer, real_addr, size);
+  fill_tlb(addr, real_addr, false);
+  unlock_library();
+
+} // vmsim_read ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void vmsim_write (void* buffer, vmsim_addr_t addr, size_t size) {
+
+  // A buffer in a native block is copied with the library unlocked, since reading it may fault.
+  uint8_t bounce[PAGESIZE];
+  lock_library();
+  if (in_native(buffer, size)) {
+    assert(size <= PAGESIZE);
+    unlock_library();
+    memcpy(bounce, buffer, size);
+    buffer = bounce;
+    lock_library();
+  }
+  vmsim_addr_t real_addr = vmsim_map(addr, true);
+  vmsim_write_real(buffer, real_addr, size);
+  fill_tlb(addr, real_addr, true);
+  unlock_library();
+
+} // vmsim_write ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Translate a simulated address, and pin its page so that further translations cannot evict it.
+ *
+ * \param  sim_addr        The _simulated_ address to translate.
+ * \param  write_operation Whether the access is a write.
+ * \return the translated _real_ address.
+ */
+static vmsim_addr_t map_pinned (vmsim_addr_t sim_addr, bool write_operation) {
+
+  vmsim_addr_t real_addr = vmsim_map(sim_addr, write_operation);
+  frames.pins[GET_FRAME(real_addr)] += 1;
+  refresh_evictable(GET_FRAME(real_addr));
+  return real_addr;
+
+} // map_pinned ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Release a pin taken by `map_pinned()`.
+ *
+ * \param real_addr The _real_ address that it returned.
+ */
+static void unpin_real (vmsim_addr_t real_addr) {
+
+  frames.pins[GET_FRAME(real_addr)] -= 1;
+  refresh_evictable(GET_FRAME(real_addr));
+
+} // unpin_real ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * The position of one operation of a batch in address order, and the _real_ address of its page once translated.
+ */
+typedef struct {
+  vmsim_addr_t page;
+  vmsim_addr_t real_page;
+  size_t       index;
+} batch_key_t;
+
+/**
+ * Order batch operations by page, and then by their order in the batch.
+ */
+static int compare_batch_keys (const void* a, const void* b) {
+
+  const batch_key_t* key_a = a;
+  const batch_key_t* key_b = b;
+  if (key_a->page != key_b->page) {
+    return (key_a->page < key_b->page) ? -1 : 1;
+  }
+  return (key_a->index < key_b->index) ? -1 : (key_a->index > key_b->index);
+
+} // compare_batch_keys ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Perform a batch of reads or writes, walking the page table once for each distinct page.  The pages are translated in address
+ * order, servicing their faults, and pinned until the copies are done.  A batch that touches too many pages to pin at once is
+ * done a run of pages at a time.  Operations on a page are copied in their order in the batch; since no operation straddles a
+ * page, those on different pages do not overlap, so the batch has the same effect as doing its operations in order.  Operations
+ * whose buffers lie in native blocks are copied through bounce buffers, which are filled from them, or copied into them, with the
+ * library unlocked.
+ *
+ * \param ops             The operations.
+ * \param count           The number of operations.
+ * \param write_operation Whether the operations are writes.
+ */
+static void run_batch (vmsim_op_t* ops, size_t count, bool write_operation) {
+
+  batch_key_t* keys = malloc((count + 1) * sizeof(batch_key_t));
+  assert(keys != NULL);
+  for (size_t i = 0; i < count; i += 1) {
+    keys[i].page  = GET_PAGE_ADDR(ops[i].addr);
+    keys[i].index = i;
+  }
+  qsort(keys, count, sizeof(batch_key_t), compare_batch_keys);
+
+  lock_library();
+  size_t bounce_size = 0;
+  for (size_t i = 0; i < count; i += 1) {
+    if (in_native(ops[i].buffer, ops[i].size)) {
+      bounce_size += ops[i].size;
+    }
+  }
+  vmsim_op_t* caller_ops = ops;
+  uint8_t*    bounce     = NULL;
+  if (bounce_size > 0) {
+    ops    = malloc(count * sizeof(vmsim_op_t));
+    bounce = malloc(bounce_size);
+    assert(ops != NULL && bounce != NULL);
+    memcpy(ops, caller_ops, count * sizeof(vmsim_op_t));
+    size_t position = 0;
+    for (size_t i = 0; i < count; i += 1) {
+      if (in_native(caller_ops[i].buffer, caller_ops[i].size)) {
+        ops[i].buffer = bounce + position;
+        position += ops[i].size;
+      }
+    }
+    if (write_operation) {
+      unlock_library();
+      for (size_t i = 0; i < count; i += 1) {
+        if (ops[i].buffer != caller_ops[i].buffer) {
+          memcpy(ops[i].buffer, caller_ops[i].buffer, ops[i].size);
+        }
+      }
+      lock_library();
+    }
+  }
+  uint64_t max_pinned = (num_entries - FIRST_POOL_FRAME) / BATCH_PIN_FRACTION;
+  if (max_pinned == 0) {
+    max_pinned = 1;
+  }
+  for (size_t start = 0; start < count;) {
+
+    // Translate and pin the next run of distinct pages, counting an access for every operation on each.
+    size_t   end    = start;
+    uint64_t pinned = 0;
+    while (end < count && (pinned < max_pinned || keys[end].page == keys[end - 1].page)) {
+      if (end == start || keys[end].page != keys[end - 1].page) {
+        keys[end].real_page = GET_PAGE_ADDR(map_pinned(ops[keys[end].index].addr, write_operation));
+        pinned += 1;
+      } else {
+        keys[end].real_page = keys[end - 1].real_page;
+        if (record_file != NULL) {
+          uint64_t page_number = keys[end].page >> PAGE_SHIFT;
+          fwrite(&page_number, sizeof(page_number), 1, record_file);
+        }
+        charge_accesses(GET_FRAME(keys[end].real_page), 1);
+      }
+      end += 1;
+    }
+
+    // Copy, and then unpin the run.
+    for (size_t i = start; i < end; i += 1) {
+      vmsim_op_t*  op        = &ops[keys[i].index];
+      vmsim_addr_t real_addr = keys[i].real_page | GET_OFFSET(op->addr);
+      if (write_operation) {
+        vmsim_write_real(op->buffer, real_addr, op->size);
+      } else {
+        vmsim_read_real(op->buffer, real_addr, op->size);
+      }
+    }
+    for (size_t i = start; i < end; i += 1) {
+      if (i == start || keys[i].page != keys[i - 1].page) {
+        unpin_real(keys[i].real_page);
+      }
+    }
+    start = end;
+
+  }
+  unlock_library();
+  free(keys);
+
+  // Deliver what was read into the bounce buffers, in the order of the batch.
+  if (bounce != NULL) {
+    for (size_t i = 0; i < count && !write_operation; i += 1) {
+      if (ops[i].buffer != caller_ops[i].buffer) {
+        memcpy(caller_ops[i].buffer, ops[i].buffer, ops[i].size);
+      }
+    }
+    free(ops);
+    free(bounce);
+  }
+
+} // run_batch ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void vmsim_read_batch (vmsim_op_t* ops, size_t count) {
+
+  run_batch(ops, count, false);
+
+} // vmsim_read_batch ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void vmsim_write_batch (vmsim_op_t* ops, size_t count) {
+
+  run_batch(ops, count, true);
+
+} // vmsim_write_batch ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * Copy bytes between two simulated regions, in pieces that lie within one page of each.  The source page of each piece is pinned
+ * while the destination page is translated, since that may cause a fault.
+ *
+ * \param dst      The _simulated_ address to which to copy.
+ * \param src      The _simulated_ address from which to copy.
+ * \param size     The number of bytes to copy.
+ * \param backward Whether to copy from the end to the start, as when the destination overlaps the source from above.
+ */
+static void copy_range (vmsim_addr_t dst, vmsim_addr_t src, size_t size, bool backward) {
+
+  lock_library();
+  size_t done = 0;
+  while (done < size) {
+
+    // Find the next piece:  as much as lies within the current pages of both regions.
+    size_t piece;
+    size_t offset;
+    if (backward) {
+      piece = size - done;
+      if (GET_OFFSET((src + size - done - 1)) + 1 < piece) {
+        piece = GET_OFFSET((src + size - done - 1)) + 1;
+      }
+      if (GET_OFFSET((dst + size - done - 1)) + 1 < piece) {
+        piece = GET_OFFSET((dst + size - done - 1)) + 1;
+      }
+      offset = size - done - piece;
+    } else {
+      piece = size - done;
+      if (PAGESIZE - GET_OFFSET((src + done)) < piece) {
+        piece = PAGESIZE - GET_OFFSET((src + done));
+      }
+      if (PAGESIZE - GET_OFFSET((dst + done)) < piece) {
+        piece = PAGESIZE - GET_OFFSET((dst + done));
+      }
+      offset = done;
+    }
+
+    vmsim_addr_t real_src = map_pinned(src + offset, false);
+    vmsim_addr_t real_dst = vmsim_map(dst + offset, true);
+    memmove(real_base + real_dst, real_base + real_src, piece);
+    unpin_real(real_src);
+    done += piece;
+
+  }
+  unlock_library();
+
+} // copy_range ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void vmsim_memcpy (vmsim_addr_t dst, vmsim_addr_t src, size_t size) {
+
+  copy_range(dst, src, size, false);
+
+} // vmsim_memcpy ()
+// =================================================================================================================================
 
-// Where to find the next page of real memory for page table blocks.
-static vmsim_addr_t pt_free_addr    = PAGESIZE;
 
-// Where to find the next page of real memory for backing simulated pages.
-static vmsim_addr_t real_free_addr  = PT_AREA_SIZE;
 
-// The base real address of the upper page table.
-static vmsim_addr_t upper_pt        = 0;
+// =================================================================================================================================
+void vmsim_memmove (vmsim_addr_t dst, vmsim_addr_t src, size_t size) {
 
-// Used by the heap allocator, the address of the next free simulated address.
-static vmsim_addr_t sim_free_addr   = 0;
+  copy_range(dst, src, size, dst > src && dst - src < size);
 
-// The next available block number on the backing store.
-static int next_block_number 	    = 1;
+} // vmsim_memmove ()
+// =================================================================================================================================
 
-// The list of page entries.
-static pt_entry_t** entries         = NULL;
 
-// The number of page entries available.
-static uint64_t num_entries         = (DEFAULT_REAL_MEMORY_SIZE - PT_AREA_SIZE) / PAGESIZE;
 
-// The current page number that we're pointing at (for the Clock Algorithm to go around).
-static uint64_t current_page_number = 0;
+// =================================================================================================================================
+void vmsim_memset (vmsim_addr_t dst, uint8_t value, size_t size) {
 
-// Function declarations for Clock Algorithm and page swapping utilities
-pt_entry_t*  find_lru      ();
-vmsim_addr_t from_mm_to_bs (pt_entry_t* entry_ptr);
-void         from_bs_to_mm (vmsim_addr_t entry_address, vmsim_addr_t real_address);
-void         swap_pages    (vmsim_addr_t bs_page, pt_entry_t* mm_page);
+  lock_library();
+  size_t done = 0;
+  while (done < size) {
+
+    size_t piece = PAGESIZE - GET_OFFSET((dst + done));
+    if (size - done < piece) {
+      piece = size - done;
+    }
+
+    // Zero a whole page by unmapping it, so that its next access maps a fresh zero-filled page; otherwise, set the bytes.  A page
+    // of a mapped file would be read from the file again, so it is always set.
+    if (value != 0 || piece < PAGESIZE || mapped_file(dst + done) != NULL || !unmap_page(dst + done)) {
+      vmsim_addr_t real_dst = vmsim_map(dst + done, true);
+      memset(real_base + real_dst, value, piece);
+    }
+    done += piece;
+
+  }
+  unlock_library();
+
+} // vmsim_memset ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
-/**
- * Allocate a page of real memory space for a page table block.  Taken from a region of real memory reserved for this purpose.
- *
- * \return The _real_ base address of a page of memory for a page table block.
- */
-vmsim_addr_t allocate_pt () {
+void** vmsim_pin (vmsim_addr_t sim_addr, size_t size, bool write_operation) {
+
+  lock_library();
+
+  // One pointer for each page touched, plus the terminator.
+  vmsim_addr_t first     = GET_PAGE_ADDR(sim_addr);
+  vmsim_addr_t last      = GET_PAGE_ADDR((sim_addr + (size > 0 ? size - 1 : 0)));
+  uint64_t     num_pages = ((last - first) >> PAGE_SHIFT) + 1;
+  void**       pages     = calloc(num_pages + 1, sizeof(void*));
+  assert(pages != NULL);
+
+  // Fault each page in and pin it right away, so that faulting in the ones after it cannot evict it.
+  for (uint64_t i = 0; i < num_pages; i += 1) {
+    vmsim_addr_t page      = first + (i << PAGE_SHIFT);
+    vmsim_addr_t real_addr = vmsim_map(page, write_operation);
+    frames.pins[GET_FRAME(real_addr)] += 1;
+    refresh_evictable(GET_FRAME(real_addr));
+    pages[i] = real_base + real_addr;
+  }
+  pages[0] += GET_OFFSET(sim_addr);
+
+  unlock_library();
+  return pages;
 
-  vmsim_addr_t new_pt_addr = pt_free_addr;
-  pt_free_addr += PAGESIZE;
-  assert(IS_ALIGNED(new_pt_addr));
-  assert(pt_free_addr <= PT_AREA_SIZE);
-  void* new_pt_ptr = (void*)(real_base + new_pt_addr);
-  memset(new_pt_ptr, 0, PAGESIZE);
-  
-  return new_pt_addr;
-  
-} // allocate_pt ()
+} // vmsim_pin ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
-/**
- * Allocate a page of real memory space for backing a simulated page.  Taken from the general pool of real memory.
- *
- * \return The _real_ base address of a page of memory.
- */
-vmsim_addr_t allocate_real_page () {
+void vmsim_unpin (void** pages) {
+
+  lock_library();
+  for (uint64_t i = 0; pages[i] != NULL; i += 1) {
+    uint64_t frame = GET_FRAME((uint64_t) (pages[i] - real_base));
+    assert(frames.pins[frame] > 0);
+    frames.pins[frame] -= 1;
+    refresh_evictable(frame);
+  }
+  free(pages);
+  unlock_library();
 
-  vmsim_addr_t new_real_addr = real_free_addr;
-  real_free_addr += PAGESIZE;
-  assert(IS_ALIGNED(new_real_addr));
+} // vmsim_unpin ()
+// =================================================================================================================================
 
-  /** Are we out of main memory space? If so, we have to swap some pages. */
-  if (real_free_addr > real_size) { 
 
-    /** Find the least-recently used entry. */
-    pt_entry_t* entry = find_lru();
 
-    /** Move the contents of that entry to the backing store, and get the
-     *  address of the page we just freed. */
-    vmsim_addr_t address = from_mm_to_bs(entry);
+// =================================================================================================================================
+void vmsim_get_stats (vmsim_stats_t* stats_out) {
 
-    /** Return the newly-freed page address. */
-    return address;
-  }
-    
-  void* new_real_ptr = (void*) (real_base + new_real_addr);
-  memset(new_real_ptr, 0, PAGESIZE);
+  lock_library();
+  *stats_out = stats;
+  stats_out->sim_time = sim_clock - sim_clock_start;
+  unlock_library();
 
-  return new_real_addr;
-  
-} // allocate_real_page ()
+} // vmsim_get_stats ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
-void vmsim_init () {
+void vmsim_reset_stats () {
 
-  // Only initialize if it hasn't already happened.
-  if (real_base == NULL) {
+  lock_library();
+  memset(&stats, 0, sizeof(stats));
+  sim_clock_start = sim_clock;
+  unlock_library();
 
-    // Determine the real memory size, preferrably by environment variable, otherwise use the default.
-    char* real_size_envvar = getenv("VMSIM_REAL_MEM_SIZE");
-    if (real_size_envvar != NULL) {
-      errno = 0;
-      real_size = strtoul(real_size_envvar, NULL, 10);
-      assert(errno == 0);
-    }
+} // vmsim_reset_stats ()
+// =================================================================================================================================
 
-    // Map the real storage space.
-    real_base = mmap(NULL, real_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    assert(real_base != NULL);
-    real_limit = (void*)((intptr_t)real_base + real_size);
-    upper_pt = allocate_pt();
 
-    // Initialize the simualted space allocator.  Leave page 0 unused, start at page 1.
-    sim_free_addr = PAGESIZE;
 
-    // Initialize the supporting components.
-    mmu_init(upper_pt);
-    bs_init();
+// =================================================================================================================================
+void vmsim_get_pff (vmsim_pff_t* pff) {
+
+  lock_library();
+  measure_pff(pff);
+  unlock_library();
+
+} // vmsim_get_pff ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void vmsim_on_thrashing (vmsim_thrashing_fn_t fn, void* arg) {
+
+  lock_library();
+  thrashing_fn  = fn;
+  thrashing_arg = arg;
+  unlock_library();
+
+} // vmsim_on_thrashing ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void vmsim_scan_idle () {
+
+  lock_library();
+  scan_idle();
+  unlock_library();
+
+} // vmsim_scan_idle ()
+// =================================================================================================================================
+
 
-    // Initialize the array to hold lower page table entries.
-    num_entries = (real_size - PT_AREA_SIZE) / PAGESIZE;
-    entries = malloc(sizeof(vmsim_addr_t) * num_entries);
-    
+
+// =================================================================================================================================
+uint64_t vmsim_get_heatmap (vmsim_region_heat_t** regions) {
+
+  lock_library();
+  build_heatmap();
+  uint64_t count = 0;
+  *regions = calloc(num_allocations + 1, sizeof(vmsim_region_heat_t));
+  assert(*regions != NULL);
+  for (uint64_t i = 0; i < num_allocations; i += 1) {
+    if (heatmap[i].size > 0) {
+      (*regions)[count] = heatmap[i];
+      count += 1;
+    }
   }
-  
-} // vmsim_init ()
+  unlock_library();
+  return count;
+
+} // vmsim_get_heatmap ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
 /**
- * Map a _simulated_ address to a _real_ one, ensuring first that the page table and real spaces are initialized.
+ * Allocate a block of simulated space.
  *
- * \param  sim_addr        The _simulated_ address to translate.
- * \param  write_operation Whether the memory access is to _read_ (`false`) or to _write_ (`true`).
- * \return the translated _real_ address.
- */ 
-vmsim_addr_t vmsim_map (vmsim_addr_t sim_addr, bool write_operation) {
+ * \param  size The number of bytes to allocate.
+ * \return the _simulated_ address of the block.
+ */
+static vmsim_addr_t allocate_sim (size_t size) {
+
+  // Pointer-bumping allocator with no reuse of simulated space.
+  vmsim_addr_t addr = sim_free_addr;
+  sim_free_addr += size;
+
+  // Remember the block so that its pages can be unmapped when it is freed.
+  if (num_allocations == max_allocations) {
+    max_allocations = (max_allocations == 0) ? 64 : max_allocations * 2;
+    allocations = realloc(allocations, max_allocations * sizeof(allocation_t));
+    assert(allocations != NULL);
+  }
+  allocations[num_allocations].base = addr;
+  allocations[num_allocations].size = size;
+  num_allocations += 1;
+  return addr;
+
+} // allocate_sim ()
+// =================================================================================================================================
+
 
-  vmsim_init();
 
-  assert(real_base != NULL);
-  vmsim_addr_t real_addr = mmu_translate(sim_addr, write_operation);
-  return real_addr;
-  
-} // vmsim_map ()
+// =================================================================================================================================
+vmsim_addr_t vmsim_alloc (size_t size) {
+
+  lock_library();
+  vmsim_addr_t addr = allocate_sim(size);
+  unlock_library();
+  return addr;
+
+} // vmsim_alloc ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
 /**
- * Called when the translation of a _simulated_ address fails.  When this function is done, a _real_ page will back the _simulated_
- * one that contains the given address, with the page tables appropriately updated.
+ * Free a block of simulated space, if there is one at the given address.
  *
- * \param sim_addr The _simulated_ address for which address translation failed.
+ * \param ptr The _simulated_ address of the block.
  */
-void vmsim_map_fault (vmsim_addr_t sim_addr) {
+static void free_sim (vmsim_addr_t ptr) {
+
+  // Find the block; the bump allocator keeps them in address order.
+  uint64_t low  = 0;
+  uint64_t high = num_allocations;
+  while (low < high) {
+    uint64_t middle = (low + high) / 2;
+    if (allocations[middle].base < ptr) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == num_allocations || allocations[low].base != ptr || allocations[low].size == 0) {
+    return;
+  }
+
+  // Unmap only the pages wholly inside the block, since its neighbors may share the pages at either end.
+  vmsim_addr_t first = GET_PAGE_ADDR((ptr + OFFSET_MASK));
+  vmsim_addr_t last  = GET_PAGE_ADDR((ptr + allocations[low].size));
+  for (vmsim_addr_t page = first; page < last; page += PAGESIZE) {
+    unmap_page(page);
+  }
+  allocations[low].size = 0;
+
+  // A mapped file is closed once its dirty pages have been written back to it.
+  file_map_t* map = mapped_file(ptr);
+  if (map != NULL && map->sim_base == ptr) {
+    close(map->fd);
+    map->size = 0;
+  }
+
+} // free_sim ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void vmsim_free (vmsim_addr_t ptr) {
+
+  lock_library();
+  free_sim(ptr);
+  unlock_library();
+
+} // vmsim_free ()
+// =================================================================================================================================
 
-  assert(upper_pt != 0);
 
-  // Grab the upper table's entry.
-  vmsim_addr_t upper_index    = GET_UPPER_INDEX(sim_addr);
-  vmsim_addr_t upper_pte_addr = upper_pt + (upper_index * sizeof(pt_entry_t));
-  pt_entry_t   upper_pte;
-  vmsim_read_real(&upper_pte, upper_pte_addr, sizeof(upper_pte));
 
-  // If the lower table doesn't exist, create it and update the upper table.
-  if (upper_pte == 0) {
+// =================================================================================================================================
+vmsim_addr_t vmsim_map_file (const char* path, uint64_t offset, size_t len) {
 
-    upper_pte = allocate_pt();
-    assert(upper_pte != 0);
-    vmsim_write_real(&upper_pte, upper_pte_addr, sizeof(upper_pte));
-    
+  // Open the file to be written back to if possible, and otherwise only to be read.
+  if (!IS_ALIGNED(offset) || len == 0) {
+    return 0;
+  }
+  bool writable = true;
+  int  fd       = open(path, O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    writable = false;
+    fd       = open(path, O_RDONLY | O_CLOEXEC);
+  }
+  if (fd < 0) {
+    return 0;
   }
 
-  // Grab the lower table's entry.
-  vmsim_addr_t lower_pt       = GET_PAGE_ADDR(upper_pte);
-  vmsim_addr_t lower_index    = GET_LOWER_INDEX(sim_addr);
-  vmsim_addr_t lower_pte_addr = lower_pt + (lower_index * sizeof(pt_entry_t));
-  pt_entry_t   lower_pte;
-  vmsim_read_real(&lower_pte, lower_pte_addr, sizeof(lower_pte));
+  // Give the mapping whole pages of simulated space, so that no other block shares them.
+  lock_library();
+  sim_free_addr = GET_PAGE_ADDR((sim_free_addr + OFFSET_MASK));
+  if (num_file_maps == max_file_maps) {
+    max_file_maps = (max_file_maps == 0) ? 16 : max_file_maps * 2;
+    file_maps = realloc(file_maps, max_file_maps * sizeof(file_map_t));
+    assert(file_maps != NULL);
+  }
+  file_map_t* map = &file_maps[num_file_maps];
+  map->sim_base   = allocate_sim((len + OFFSET_MASK) & ~((size_t) OFFSET_MASK));
+  map->size       = len;
+  map->fd         = fd;
+  map->offset     = offset;
+  map->writable   = writable;
+  num_file_maps += 1;
+  unlock_library();
+  return map->sim_base;
+
+} // vmsim_map_file ()
+// =================================================================================================================================
 
-  // If there is no mapped page, create it and update the lower table.
-  if (lower_pte == 0) {
 
-    lower_pte = allocate_real_page();
-    vmsim_addr_t real_addr = lower_pte;
-    SET_RESIDENT(lower_pte);
-    vmsim_write_real(&lower_pte, lower_pte_addr, sizeof(lower_pte));
-    
-    // Add the new page to the list of main memory page entries.
-    uint64_t page_number = (real_addr - PT_AREA_SIZE) / PAGESIZE;
-    entries[page_number] = (pt_entry_t*) (lower_pte_addr + real_base);
 
-  }  
+// =================================================================================================================================
+/**
+ * Service the host's faults on the native blocks, one at a time:  translate the faulting page, just as an access through
+ * `vmsim_read()` or `vmsim_write()` would be, and copy its contents into the block, write-protected unless the access was a write
+ * so that a later write faults to set the dirty bit.  The faulting thread resumes once the copy is in place.
+ *
+ * \param  unused No argument.
+ * \return nothing.
+ */
+static void* native_loop (void* unused) {
 
-  // Is the page resident? If not, we must swap it in with the least-recently
-  // used page.
-  if (!IS_RESIDENT(lower_pte)) {
+  struct uffd_msg message;
+  while (read(native_fd, &message, sizeof(message)) == sizeof(message)) {
 
-    pt_entry_t* lru_page = find_lru();
-    swap_pages(lower_pte_addr, lru_page);
+    if (message.event != UFFD_EVENT_PAGEFAULT) {
+      continue;
+    }
+    uint8_t* address = (uint8_t*) (uintptr_t) message.arg.pagefault.address;
+    bool     write   = (message.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE) != 0;
+
+    // A fault on a block that has since been freed needs nothing, since freeing it woke the faulting thread.
+    lock_library();
+    for (uint64_t i = 0; i < num_natives; i += 1) {
+      if ((uint64_t) (address - natives[i].host) >= natives[i].size) {
+        continue;
+      }
+      vmsim_addr_t offset    = GET_PAGE_ADDR(((vmsim_addr_t) (address - natives[i].host)));
+      vmsim_addr_t real_addr = vmsim_map(natives[i].sim_base + offset, write);
+
+      // The copy relies on `vmsim_map()` having run `withdraw_native()`, which dropped any copy of the page already in the block.
+      // Without that, a second fault on the page, such as a write to one that was copied in write-protected, or a fault that
+      // another thread took on it meanwhile, would find it present, and the copy would fail with `EEXIST`.
+      struct uffdio_copy copy;
+      copy.dst  = (uintptr_t) (natives[i].host + offset);
+      copy.src  = (uintptr_t) (real_base + GET_PAGE_ADDR(real_addr));
+      copy.len  = PAGESIZE;
+      copy.mode = write ? 0 : UFFDIO_COPY_MODE_WP;
+      int copied = ioctl(native_fd, UFFDIO_COPY, &copy);
+      assert(copied == 0);
+      set_frame_bit(frames.windowed, GET_FRAME(real_addr), true);
+      break;
+    }
+    unlock_library();
 
   }
-    
-  
-} // vmsim_map_fault ()
+  return NULL;
+
+} // native_loop ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
-void vmsim_read_real (void* buffer, vmsim_addr_t real_addr, size_t size) {
+/**
+ * Open the userfaultfd through which the host reports faults on the native blocks, and start the thread that services them.
+ *
+ * \return whether the host supports native mode:  it must allow this process a userfaultfd, and write-protect faults on anonymous
+ *         memory (Linux 5.7 and later).
+ */
+static bool start_native () {
 
-  // Get a pointer into the real space and check the bounds.
-  void* ptr = real_base + real_addr;
-  void* end = (void*) ((intptr_t) ptr + size);
-  assert(end <= real_limit);
+  native_fd = syscall(SYS_userfaultfd, O_CLOEXEC);
+  if (native_fd < 0) {
+    return false;
+  }
+  struct uffdio_api api;
+  api.api      = UFFD_API;
+  api.features = UFFD_FEATURE_PAGEFAULT_FLAG_WP;
+  if (ioctl(native_fd, UFFDIO_API, &api) != 0 || (api.features & UFFD_FEATURE_PAGEFAULT_FLAG_WP) == 0) {
+    close(native_fd);
+    native_fd = -1;
+    return false;
+  }
 
-  // Copy the requested bytes from the real space.
-  memcpy(buffer, ptr, size);
-  
-} // vmsim_read_real ()
+  int created = pthread_create(&native_thread, NULL, native_loop, NULL);
+  assert(created == 0);
+  pthread_detach(native_thread);
+  return true;
+
+} // start_native ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
-void vmsim_write_real (void* buffer, vmsim_addr_t real_addr, size_t size) {
+void* vmsim_native_alloc (size_t size) {
 
-  // Get a pointer into the real space and check the bounds.
-  void* ptr = real_base + real_addr;
-  void* end = (void*) ((intptr_t) ptr + size);
-  assert(end <= real_limit);
+  lock_library();
+  if (size == 0 || (native_fd < 0 && !start_native())) {
+    unlock_library();
+    return NULL;
+  }
 
-  // Copy the requested bytes into the real space.
-  memcpy(ptr, buffer, size);
-  
-} // vmsim_write_real ()
+  // Reserve host address space for the block, aligned to the page size, and have the host report its faults.
+  size = (size + OFFSET_MASK) & ~((size_t) OFFSET_MASK);
+  uint8_t* reserved = mmap(NULL, size + PAGESIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (reserved == MAP_FAILED) {
+    unlock_library();
+    return NULL;
+  }
+  uint8_t* host = (uint8_t*) (((uintptr_t) reserved + OFFSET_MASK) & ~((uintptr_t) OFFSET_MASK));
+  if (host > reserved) {
+    munmap(reserved, host - reserved);
+  }
+  munmap(host + size, (reserved + PAGESIZE) - host);
+  struct uffdio_register registration;
+  registration.range.start = (uintptr_t) host;
+  registration.range.len   = size;
+  registration.mode        = UFFDIO_REGISTER_MODE_MISSING | UFFDIO_REGISTER_MODE_WP;
+  if (ioctl(native_fd, UFFDIO_REGISTER, &registration) != 0) {
+    munmap(host, size);
+    unlock_library();
+    return NULL;
+  }
+
+  // Give it a block of simulated space that starts on a page boundary, so that the two match page for page.
+  sim_free_addr = GET_PAGE_ADDR((sim_free_addr + OFFSET_MASK));
+  if (num_natives == max_natives) {
+    max_natives = (max_natives == 0) ? 16 : max_natives * 2;
+    natives = realloc(natives, max_natives * sizeof(native_block_t));
+    assert(natives != NULL);
+  }
+  natives[num_natives].sim_base = allocate_sim(size);
+  natives[num_natives].size     = size;
+  natives[num_natives].host     = host;
+  num_natives += 1;
+
+  unlock_library();
+  return host;
+
+} // vmsim_native_alloc ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
-void vmsim_read (void* buffer, vmsim_addr_t addr, size_t size) {
+void vmsim_native_free (void* ptr) {
+
+  lock_library();
+  for (uint64_t i = 0; i < num_natives; i += 1) {
+    if (natives[i].host == ptr && natives[i].size > 0) {
+      free_sim(natives[i].sim_base);
+      munmap(natives[i].host, natives[i].size);
+      natives[i].size = 0;
+      break;
+    }
+  }
+  unlock_library();
 
-  vmsim_addr_t real_addr = vmsim_map(addr, false);
-  vmsim_read_real(buffer, real_addr, size);
+} // vmsim_native_free ()
+// =================================================================================================================================
 
-} // vmsim_read ()
+
+
+// =================================================================================================================================
+vmsim_addr_t vmsim_native_addr (const void* ptr) {
+
+  lock_library();
+  vmsim_addr_t sim_addr = 0;
+  for (uint64_t i = 0; i < num_natives; i += 1) {
+    if ((uint64_t) ((const uint8_t*) ptr - natives[i].host) < natives[i].size) {
+      sim_addr = natives[i].sim_base + (vmsim_addr_t) ((const uint8_t*) ptr - natives[i].host);
+      break;
+    }
+  }
+  unlock_library();
+  return sim_addr;
+
+} // vmsim_native_addr ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
-void vmsim_write (void* buffer, vmsim_addr_t addr, size_t size) {
+bool vmsim_resize (size_t size) {
 
-  vmsim_addr_t real_addr = vmsim_map(addr, true);
-  vmsim_write_real(buffer, real_addr, size);
+  lock_library();
 
-} // vmsim_write ()
+  // The new size must hold the reserved frames and a frame for each node, and fit within the reserved space.  Real memory cannot
+  // shrink past a pinned frame, whose host pointer has been given out.
+  uint64_t new_entries = size / PAGESIZE;
+  bool     possible    = (new_entries >= FIRST_POOL_FRAME + 2 * pt_levels && new_entries - FIRST_POOL_FRAME >= num_nodes &&
+                          new_entries <= max_entries);
+  for (uint64_t frame = new_entries; possible && frame < num_entries; frame += 1) {
+    possible = (frames.pins[frame] == 0);
+  }
+  if (!possible) {
+    unlock_library();
+    return false;
+  }
+
+  if (new_entries < num_entries) {
+
+    // Stop handing out the frames to be removed, but leave the clock going around them, so that it chooses victims as it would.
+    limit_nodes(new_entries);
+
+    // Empty each frame to be removed that is still in use, moving its contents to a free frame that stays.  When there is none, one
+    // is made by evicting the clock's choice, which may itself be a frame to be removed.
+    for (uint64_t frame = new_entries; frame < num_entries; frame += 1) {
+      while (frames.pte[frame] != NULL) {
+        uint64_t free_frame = NULL_FRAME;
+        bool     found      = false;
+        for (unsigned int i = 0; i < num_nodes && !found; i += 1) {
+          found = take_node_frame((frame_node(frame) + i) % num_nodes, &free_frame, NULL);
+        }
+        if (!found) {
+          free_frame = GET_FRAME(from_mm_to_bs(find_lru()));
+          if (free_frame >= new_entries) {
+            continue;
+          }
+        }
+        move_frame(frame, free_frame);
+      }
+    }
+
+    // Hand the removed frames' host memory back; should real memory grow again, they will read as zeros, as never-used frames must,
+    // even if they were mapped from a checkpoint.
+    host_discard(real_base + (new_entries * PAGESIZE), (num_entries - new_entries) * PAGESIZE);
+    num_entries = new_entries;
+    if (current_page_number >= num_entries) {
+      current_page_number = FIRST_POOL_FRAME;
+    }
+    if (sample_hand >= num_entries) {
+      sample_hand = FIRST_POOL_FRAME;
+    }
+
+  } else {
+
+    // The new frames are simply never-used ones at the ends of their nodes.
+    num_entries = new_entries;
+    limit_nodes(num_entries);
+
+  }
+  real_size  = num_entries * PAGESIZE;
+  real_limit = real_base + real_size;
+
+  unlock_library();
+  return true;
+
+} // vmsim_resize ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
-vmsim_addr_t vmsim_alloc (size_t size) {
+/**
+ * Move a checkpoint's position up to the next multiple of the page size, so that what follows can be mapped from the file.
+ *
+ * \param file The checkpoint.
+ */
+static void align_checkpoint (FILE* file) {
 
-  vmsim_init();
+  long position = ftell(file);
+  fseek(file, (position + OFFSET_MASK) & ~((long) OFFSET_MASK), SEEK_SET);
 
-  // Pointer-bumping allocator with no reclamation.
-  vmsim_addr_t addr = sim_free_addr;
-  sim_free_addr += size;
-  return addr;
-  
-} // vmsim_alloc ()
+} // align_checkpoint ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
-void vmsim_free (vmsim_addr_t ptr) {
+bool vmsim_checkpoint (const char* path) {
+
+  lock_library();
+
+  // Write to a file of another name, and put it in place only once it is complete, so that a checkpoint from which real memory
+  // is mapped can be overwritten safely.  The pages of mapped files are not in real memory or on the backing store to be saved.
+  char* temp_path = malloc(strlen(path) + 5);
+  assert(temp_path != NULL);
+  sprintf(temp_path, "%s.tmp", path);
+  FILE* file = files_mapped() ? NULL : fopen(temp_path, "w");
+  if (file == NULL) {
+    free(temp_path);
+    unlock_library();
+    return false;
+  }
 
-  // No reclamation, so nothing to do.
+  checkpoint_header_t header = { { 0 } };
+  memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  header.version             = CHECKPOINT_VERSION;
+  header.page_shift          = PAGE_SHIFT;
+  header.addr_size           = sizeof(vmsim_addr_t);
+  header.pt_levels           = pt_levels;
+  header.num_nodes           = num_nodes;
+  header.next_block_number   = next_block_number;
+  header.num_entries         = num_entries;
+  header.max_entries         = max_entries;
+  header.sim_free_addr       = sim_free_addr;
+  header.num_allocations     = num_allocations;
+  header.num_free_blocks     = num_free_blocks;
+  header.current_page_number = current_page_number;
+  header.sample_hand         = sample_hand;
+  header.sample_countdown    = sample_countdown;
+  header.sim_clock           = sim_clock;
+  header.sim_clock_start     = sim_clock_start;
+  header.stats               = stats;
+
+  // The backing store's blocks, and real memory, into which native pages that are dirty must first be copied back.
+  for (uint64_t frame = FIRST_POOL_FRAME; frame < num_entries; frame += 1) {
+    withdraw_native(frame, true);
+  }
+  fseek(file, sizeof(header), SEEK_SET);
+  align_checkpoint(file);
+  bool written = bs_checkpoint(file, next_block_number);
+  align_checkpoint(file);
+  fwrite(real_base, PAGESIZE, num_entries, file);
+
+  // The frame table, with each frame's entry pointer saved as a real address, since real memory may be mapped elsewhere when the
+  // checkpoint is restored.  Pins are not saved, since the pointers that `vmsim_pin()` gave out will not outlive this process.
+  vmsim_addr_t* pte_addrs = calloc(num_entries, sizeof(vmsim_addr_t));
+  assert(pte_addrs != NULL);
+  for (uint64_t frame = 0; frame < num_entries; frame += 1) {
+    if (frames.pte[frame] != NULL) {
+      pte_addrs[frame] = (vmsim_addr_t) ((void*) frames.pte[frame] - real_base);
+    }
+  }
+  fwrite(pte_addrs, sizeof(vmsim_addr_t), num_entries, file);
+  free(pte_addrs);
+  fwrite(frames.sim_page, sizeof(vmsim_addr_t), num_entries, file);
+  fwrite(frames.level, sizeof(uint8_t), num_entries, file);
+  fwrite(frames.mapped, sizeof(uint32_t), num_entries, file);
+  fwrite(frames.resident, sizeof(uint32_t), num_entries, file);
+  fwrite(frames.swap_slot, sizeof(unsigned int), num_entries, file);
+  fwrite(frames.referenced, sizeof(uint64_t), frames.num_words, file);
+  fwrite(frames.sampled, sizeof(uint64_t), frames.num_words, file);
+  fwrite(frames.last_node, sizeof(uint8_t), num_entries, file);
+  fwrite(frames.young, sizeof(uint64_t), frames.num_words, file);
+  fwrite(frames.history, sizeof(uint8_t), num_entries, file);
+
+  // The allocators' state.
+  fwrite(nodes, sizeof(numa_node_t), num_nodes, file);
+  fwrite(free_frames, sizeof(uint64_t), num_entries, file);
+  fwrite(allocations, sizeof(allocation_t), num_allocations, file);
+  fwrite(free_blocks, sizeof(unsigned int), num_free_blocks, file);
+
+  // Finish the header, now that the size is known.
+  header.file_size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, file);
+  written = written && !ferror(file);
+  written = (fclose(file) == 0) && written;
+  if (written) {
+    written = (rename(temp_path, path) == 0);
+  } else {
+    remove(temp_path);
+  }
+  free(temp_path);
 
-} // vmsim_free ()
+  unlock_library();
+  return written;
+
+} // vmsim_checkpoint ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
-pt_entry_t* find_lru () {
+bool vmsim_restore (const char* path) {
+
+  lock_library();
+
+  // Check that the checkpoint is complete, and was taken with the same geometry, before changing anything.  Mapped files would be
+  // left with no place in the restored state, and real memory from the host's pool of huge pages cannot be mapped over.
+  FILE* file = (files_mapped() || real_hugetlb) ? NULL : fopen(path, "r");
+  if (file == NULL) {
+    unlock_library();
+    return false;
+  }
+  checkpoint_header_t header;
+  struct stat         status;
+  if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 ||
+      header.version != CHECKPOINT_VERSION || header.page_shift != PAGE_SHIFT || header.addr_size != sizeof(vmsim_addr_t) ||
+      header.pt_levels != pt_levels || header.num_nodes != num_nodes || header.max_entries != max_entries ||
+      fstat(fileno(file), &status) != 0 || (uint64_t) status.st_size < header.file_size) {
+    fclose(file);
+    unlock_library();
+    return false;
+  }
+
+  // The backing store's blocks, which it maps if its own configuration matches.
+  align_checkpoint(file);
+  if (!bs_restore(file, header.next_block_number)) {
+    fclose(file);
+    unlock_library();
+    return false;
+  }
 
-  // Start from the page at which our "clock hand" is currently pointing.
-  pt_entry_t entry = *entries[current_page_number];
+  // Real memory, mapped over the old, so that each page is read only when it is first touched.  Its size is the checkpoint's, and
+  // the frames beyond it are handed back, to read as zeros should it grow.  The native blocks are emptied, to be refilled from it.
+  for (uint64_t frame = FIRST_POOL_FRAME; frame < num_entries; frame += 1) {
+    withdraw_native(frame, false);
+  }
+  num_entries = header.num_entries;
+  real_size   = num_entries * PAGESIZE;
+  real_limit  = real_base + real_size;
+  align_checkpoint(file);
+  void* mapped = mmap(real_base, num_entries * PAGESIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fileno(file),
+                      ftell(file));
+  assert(mapped == real_base);
+  fseek(file, num_entries * PAGESIZE, SEEK_CUR);
+  host_discard(real_base + real_size, max_real_size - real_size);
+
+  // The frame table.
+  bool          read      = true;
+  vmsim_addr_t* pte_addrs = calloc(max_entries, sizeof(vmsim_addr_t));
+  assert(pte_addrs != NULL);
+  read = read && fread(pte_addrs, sizeof(vmsim_addr_t), num_entries, file) == num_entries;
+  for (uint64_t frame = 0; frame < max_entries; frame += 1) {
+    frames.pte[frame] = (frame >= num_entries || pte_addrs[frame] == 0) ? NULL : (pt_entry_t*) (real_base + pte_addrs[frame]);
+  }
+  free(pte_addrs);
+  read = read && fread(frames.sim_page, sizeof(vmsim_addr_t), num_entries, file) == num_entries;
+  read = read && fread(frames.level, sizeof(uint8_t), num_entries, file) == num_entries;
+  read = read && fread(frames.mapped, sizeof(uint32_t), num_entries, file) == num_entries;
+  read = read && fread(frames.resident, sizeof(uint32_t), num_entries, file) == num_entries;
+  read = read && fread(frames.swap_slot, sizeof(unsigned int), num_entries, file) == num_entries;
+  read = read && fread(frames.referenced, sizeof(uint64_t), frames.num_words, file) == frames.num_words;
+  read = read && fread(frames.sampled, sizeof(uint64_t), frames.num_words, file) == frames.num_words;
+  read = read && fread(frames.last_node, sizeof(uint8_t), num_entries, file) == num_entries;
+  read = read && fread(frames.young, sizeof(uint64_t), frames.num_words, file) == frames.num_words;
+  read = read && fread(frames.history, sizeof(uint8_t), num_entries, file) == num_entries;
+  memset(frames.pins, 0, max_entries * sizeof(uint32_t));
+  tlb_frame = NULL_FRAME;
+
+  // The allocators' state.
+  read = read && fread(nodes, sizeof(numa_node_t), num_nodes, file) == num_nodes;
+  read = read && fread(free_frames, sizeof(uint64_t), num_entries, file) == num_entries;
+  if (header.num_allocations > max_allocations) {
+    max_allocations = header.num_allocations;
+    allocations     = realloc(allocations, max_allocations * sizeof(allocation_t));
+    assert(allocations != NULL);
+  }
+  read = read && fread(allocations, sizeof(allocation_t), header.num_allocations, file) == header.num_allocations;
+  if (header.num_free_blocks > max_free_blocks) {
+    max_free_blocks = header.num_free_blocks;
+    free_blocks     = realloc(free_blocks, max_free_blocks * sizeof(unsigned int));
+    assert(free_blocks != NULL);
+  }
+  read = read && fread(free_blocks, sizeof(unsigned int), header.num_free_blocks, file) == header.num_free_blocks;
+  fclose(file);
+  if (!read) {
+    fprintf(stderr, "ERROR:\tvmsim_restore():\tTruncated checkpoint %s\n", path);
+    abort();
+  }
+
+  // The scalar state.
+  next_block_number   = header.next_block_number;
+  sim_free_addr       = header.sim_free_addr;
+  num_allocations     = header.num_allocations;
+  num_free_blocks     = header.num_free_blocks;
+  current_page_number = header.current_page_number;
+  sample_hand         = header.sample_hand;
+  sample_countdown    = header.sample_countdown;
+  sim_clock           = header.sim_clock;
+  sim_clock_start     = header.sim_clock_start;
+  stats               = header.stats;
+
+  // Evictability depends on whether page tables are pageable in this run, and every cached translation is stale.
+  for (uint64_t frame = 0; frame < max_entries; frame += 1) {
+    refresh_evictable(frame);
+  }
+  mmu_flush_walk_cache();
+  vmsim_tlb_epoch += 1;
+
+  unlock_library();
+  return true;
+
+} // vmsim_restore ()
+// =================================================================================================================================
 
-  // Keep going around the clock until we find a non-referenced page.
-  while IS_REFERENCED(entry) {
-      
-      // The current page is referenced, so clear it in advance.
-      pt_entry_t cleared_entry = CLEAR_REFERENCED(entry);
 
-      // Find the address of the current slot, to write the cleared entry into it.
-      vmsim_addr_t destination_address = (vmsim_addr_t) ((void*) entries[current_page_number] - real_base);
-      
-      // Write the cleared page back into the current slot.
-      vmsim_write_real(&cleared_entry, destination_address, sizeof(pt_entry_t));
 
-      // Move on to the next entry.
-      current_page_number = (current_page_number + 1) % num_entries;
-      entry = *entries[current_page_number];
+// =================================================================================================================================
+/**
+ * Determine whether a frame may be chosen for eviction.  Unused, reserved and pinned frames may not; nor may page tables that still
+ * have resident pages, nor any page tables at all unless they are pageable.
+ *
+ * \param  frame The frame number.
+ * \return whether the frame is a candidate for eviction.
+ */
+static bool is_evictable (uint64_t frame) {
 
+  if (frames.pte[frame] == NULL || frames.pins[frame] > 0) {
+    return false;
   }
-  
-  // Return the first non-referenced page we find.
-  return entries[current_page_number];
+  if (frames.level[frame] < pt_levels) {
+    return pageable_pts && frames.resident[frame] == 0;
+  }
+  return true;
 
-} // find_lru ()
+} // is_evictable ()
 // =================================================================================================================================
 
 
 
 // =================================================================================================================================
-void swap_pages (vmsim_addr_t bs_page, pt_entry_t* mm_page) {
+/**
+ * Bring a frame's bit in `frames.evictable` up to date.
+ *
+ * \param frame The frame number.
+ */
+static void refresh_evictable (uint64_t frame) {
+
+  set_frame_bit(frames.evictable, frame, is_evictable(frame));
+
+} // refresh_evictable ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+pt_entry_t* find_lru () {
+
+  // Go around the clock, starting from the frame at which our "clock hand" is currently pointing, until we find an evictable,
+  // non-referenced frame, clearing the reference bits of the evictable frames passed along the way.  The bitmaps let each step
+  // handle the rest of a word of 64 frames at once.  Two full sweeps clear every reference bit, so failing to find one by then
+  // means nothing can be evicted.
+  for (uint64_t steps = 0; steps < 2 * (frames.num_words + 1); steps += 1) {
+
+    uint64_t word      = current_page_number >> 6;
+    uint64_t ahead     = ~0ULL << (current_page_number & 63);
+    uint64_t evictable = frames.evictable[word] & ahead;
+    uint64_t unused    = evictable & ~(frames.referenced[word] | frames.young[word]);
+
+    // The frames to pass are those before the first candidate, or the rest of the word if there is none.
+    uint64_t passed = evictable;
+    if (unused != 0) {
+      passed = evictable & ((1ULL << __builtin_ctzll(unused)) - 1);
+    }
+
+    // Clear the reference bits of the frames passed, both in the bitmap and in their entries, along with any that idle-page
+    // tracking moved aside, and take the native pages among them out of their blocks to see whether they are used again.
+    uint64_t clearing = passed & frames.referenced[word];
+    frames.referenced[word] &= ~clearing;
+    frames.young[word]      &= ~passed;
+    sample_native(word, clearing);
+    while (clearing != 0) {
+      uint64_t frame = (word << 6) + __builtin_ctzll(clearing);
+      clearing &= clearing - 1;
+      CLEAR_REFERENCED(*frames.pte[frame]);
+    }
+
+    // Return the first non-referenced frame, moving the hand past it, or move the hand on to the next word.
+    uint64_t next_frame = (word + 1) << 6;
+    uint64_t victim     = 0;
+    if (unused != 0) {
+      victim     = (word << 6) + __builtin_ctzll(unused);
+      next_frame = victim + 1;
+    }
+    current_page_number = next_frame;
+    if (next_frame >= num_entries) {
+      current_page_number = FIRST_POOL_FRAME;
+      TRACE(TRACE_CLOCK_WRAP, 0, 0);
+    }
+    if (unused != 0) {
+      TRACE(TRACE_VICTIM, frames.sim_page[victim], victim);
+      return frames.pte[victim];
+    }
 
-  // Move the main memory page to the backing store, returning its free slot address.
-  vmsim_addr_t freed_slot = from_mm_to_bs(mm_page);
+  }
 
-  // Move the backing store page into the free slot whose address we just got.
-  from_bs_to_mm(bs_page, freed_slot);
+  fprintf(stderr, "ERROR:\tfind_lru():\tNo evictable frame in real memory\n");
+  abort();
 
-} // swap_pages ()
+} // find_lru ()
 // =================================================================================================================================
 
 
@@ -407,16 +2861,52 @@ vmsim_addr_t from_mm_to_bs (pt_entry_t* entry_ptr) {
   vmsim_addr_t free_slot_address = GET_PAGE_ADDR(entry);
 
   // Write the free slot address into the next available block of the backing
-  // store, ensure we account for the used space, and mark the fact that 
-  // the entry we just moved isn't resident in main memory anymore.
-  bs_write(free_slot_address, next_block_number);
-  entry = (entry & 0x3ff) | (next_block_number << 10);
-  next_block_number = next_block_number + 1;
-  CLEAR_RESIDENT(entry);
+  // store, and mark the fact that the entry we just moved isn't resident in
+  // main memory anymore.  A clean page whose block still holds a copy of it
+  // need not be written at all.
+  uint64_t     free_frame   = GET_FRAME(free_slot_address);
+  unsigned int block_number = frames.swap_slot[free_frame];
+  withdraw_native(free_frame, true);
+  file_map_t*  map          = file_backing(free_frame, entry);
+  if (map != NULL) {
+
+    // A page of a mapped file goes back to the file instead, and only if it is dirty.  Its entry is left to say so.
+    if (IS_DIRTY(entry)) {
+      transfer_file_page(free_frame, map, true);
+    }
+    entry = PTE_FILE_BIT;
+
+  } else {
+
+    if (block_number == 0 || IS_DIRTY(entry)) {
+      if (block_number == 0) {
+        block_number = allocate_block();
+      }
+      bool written = bs_write(free_slot_address, block_number);
+      assert(written);
+      stats.bs_writes += 1;
+      TRACE(TRACE_BS_WRITE, frames.sim_page[free_frame], block_number);
+    }
+    SET_BLOCK(entry, block_number);
+    CLEAR_RESIDENT(entry);
 
-  // Clean up pointers.
-  void* free_slot_ptr = (void*) (real_base + free_slot_address);
-  memset(free_slot_ptr, 0, PAGESIZE);
+  }
+  frames.swap_slot[free_frame] = 0;
+  stats.evictions += 1;
+
+  // Clean up pointers.  The frame keeps its old contents until whoever takes it next overwrites or clears them.
+  frames.pte[free_frame] = NULL;
+  set_frame_bit(frames.referenced, free_frame, false);
+  set_frame_bit(frames.evictable, free_frame, false);
+  set_frame_bit(frames.young, free_frame, false);
+  adjust_resident(entry_frame(entry_ptr), -1);
+  if (frames.level[free_frame] < pt_levels) {
+    mmu_flush_walk_cache();
+  }
+
+  // Cached translations may now be stale, and those of pages whose reference bits the clock just cleared must be made again so that
+  // the bits get set.
+  vmsim_tlb_epoch += 1;
 
   // Finally, copy the entry into the destination address.
   vmsim_addr_t destination_address = (vmsim_addr_t) ((void*) entry_ptr - real_base);
@@ -437,19 +2927,43 @@ void from_bs_to_mm (vmsim_addr_t entry_address, vmsim_addr_t real_address) {
   pt_entry_t entry;
   vmsim_read_real(&entry, entry_address, sizeof(pt_entry_t));
 
-  // Find the corresponding block in the backing store.
-  int block_number = (entry & 0xfffc00) >> 10;
-  bs_read(real_address, block_number);
-  
+  // Find the corresponding block in the backing store.  A simulated page keeps its block as its swap slot, and starts out clean; a
+  // page table is edited without its dirty bit being set, so its block is free once its contents are back in memory.
+  uint64_t     frame        = GET_FRAME(real_address);
+  unsigned int block_number = GET_BLOCK(entry);
+  bool         read         = bs_read(real_address, block_number);
+  assert(read);
+  stats.bs_reads += 1;
+  TRACE(TRACE_BS_READ, frames.sim_page[frame], block_number);
+  if (frames.level[frame] == pt_levels) {
+    frames.swap_slot[frame] = block_number;
+  } else {
+    release_block(block_number);
+  }
+
   // The entry can now be considered to be resident in main memory.
-  entry = (entry & 0x3ff) | real_address;
+  entry = (entry & FLAG_MASK) | real_address;
   SET_RESIDENT(entry);
+  CLEAR_DIRTY(entry);
   vmsim_write_real(&entry, entry_address, sizeof(pt_entry_t));
 
   // Add the entry to our list of main memory entries.
-  uint64_t page_number = (real_address - PT_AREA_SIZE) / PAGESIZE;
-  entries[page_number] = (pt_entry_t*) (real_base + entry_address);
+  frames.pte[frame] = (pt_entry_t*) (real_base + entry_address);
+  set_frame_bit(frames.referenced, frame, IS_REFERENCED(entry));
+  adjust_resident(GET_FRAME(entry_address), +1);
+
+  // A page table that comes back has none of its own pages resident, but needs its count of mappings restored.
+  if (frames.level[frame] < pt_levels) {
+    pt_entry_t* table = (pt_entry_t*) (real_base + real_address);
+    frames.mapped[frame]   = 0;
+    frames.resident[frame] = 0;
+    for (uint64_t i = 0; i < PAGESIZE / sizeof(pt_entry_t); i += 1) {
+      if (table[i] != 0) {
+        frames.mapped[frame] += 1;
+      }
+    }
+  }
+  refresh_evictable(frame);
 
 } // from_bs_to_mm ()
 // =================================================================================================================================
-
@@ -7,8 +7,70 @@
  *
  * `vmsim` is a package that emulates a 32-bit virtual address space.  It provides a _simulated address space_ that is mapped onto a
  * _real address space_.  The real storage is created by the library, while a full 32-bit range of simulated addresses are mapped,
- * on demand, onto that real storage space, which can be of any size.  Space is created and mapped in 4 KB pages.  Access to
- * simulated storage is provided by the `vimsim_read()` and `vmsim_write()` functions.
+ * on demand, onto that real storage space, which can be of any size.  Space is created and mapped in 4 KB pages, or in 16 KB or
+ * 64 KB pages by the `libvmsim-16k.so` and `libvmsim-64k.so` variants (see `geometry.h`).  Access to simulated storage is provided
+ * by the `vimsim_read()` and `vmsim_write()` functions.
+ *
+ * The size of the real space is taken from the `VMSIM_REAL_MEM_SIZE` environment variable, and may be changed later by
+ * `vmsim_resize()`, up to `VMSIM_REAL_MEM_MAX` (by default, the initial size), for which host address space is reserved up front.
+ * Page tables share the real space with simulated pages, and lower page tables are released when they become empty.  Setting
+ * `VMSIM_PAGEABLE_PT=1` also allows lower page tables with no resident pages to be evicted to the backing store.  Setting
+ * `VMSIM_RECORD` to a file name records the simulated page number of every access there, as a raw array of 64-bit integers, for
+ * offline analysis with `opt-sim`.  Setting `VMSIM_TRACE` to a file name records an event trace of the paging activity there (see
+ * `trace.h`).
+ *
+ * The library sets itself up when it is loaded, before `main()` runs, and reads every `VMSIM_*` environment variable then.  A
+ * program cannot configure it by calling `setenv()` itself; the variables must already be set in the environment it starts with.
+ *
+ * The library keeps a simulated clock, so that a workload's cost can be judged by time as well as by fault counts.  Each access
+ * advances it by `VMSIM_MEM_ACCESS_NS` nanoseconds (100 by default), and each backing store read advances it to the read's
+ * completion on the device described by `VMSIM_BS_DEVICE` (see `bs.h`).  Threads share the one clock, as if on one processor.
+ *
+ * Setting `VMSIM_NUMA_NODES` divides real memory into that many NUMA nodes of contiguous frames, and assigns the threads to the
+ * nodes in turn as they first call in.  An access to a frame on another node takes `VMSIM_NUMA_REMOTE_NS` nanoseconds (twice a
+ * local access by default).  Simulated pages are placed on the node of the thread that first touches them, or with
+ * `VMSIM_NUMA_POLICY=interleave`, on the nodes in turn by page number; page tables always go to the faulting thread's node.  A node
+ * with no free frames borrows from the others.  The nodes divide real memory at its largest size, so while it is smaller, the last
+ * nodes have fewer frames, or none.  Unless `VMSIM_NUMA_MIGRATE=0`, pages are sampled periodically, and a page that is
+ * used from the same remote node twice in a row is migrated there.
+ *
+ * A page-fault frequency monitor watches for thrashing over a window of the last `VMSIM_PFF_WINDOW` accesses (65536 by default),
+ * which slides an eighth of its length at a time.  The simulation starts thrashing when the window's faults per million accesses
+ * reach `VMSIM_PFF_HIGH` (10000 by default), and stops when they fall to `VMSIM_PFF_LOW` (half that by default).  Only faults
+ * that had to evict a page count, so a workload that is still filling real memory is not taken to be thrashing.  The faults are
+ * also tallied by thread, to name the worst offender when several threads share real memory.  Load control is left to the
+ * caller, which is told of each change by `vmsim_on_thrashing()`, and may poll `vmsim_get_pff()`.
+ *
+ * Idle-page tracking, much like Linux's, shows which blocks from `vmsim_alloc()` are hot and which are cold.  Every
+ * `VMSIM_IDLE_SCAN` accesses (never by default), or whenever `vmsim_scan_idle()` is called, a scan shifts each resident page's
+ * reference bit into a history of the last eight scans, and clears the bit while hiding that from the clock.  A page's heat is
+ * the number of scans in its history before which it was referenced, and the pages referenced before any of them estimate the
+ * working set.  `vmsim_get_heatmap()` totals them for each block, and setting `VMSIM_HEATMAP` to a file name writes the totals
+ * there as CSV after each scan.
+ *
+ * `vmsim_map_file()` maps a host file into the simulated space, as a page cache would hold it.  Its pages are read from the file
+ * when they are first touched, and whenever they are touched again after being evicted.  Evicting a clean page costs nothing, since
+ * the file still holds it, and a dirty one is written back to the file rather than to the backing store.  The file is read and
+ * written on the device described by `VMSIM_FILE_DEVICE` (see `bs.h`).
+ *
+ * `vmsim_native_alloc()` lets unmodified pointer-based code run under the simulation at nearly native speed.  It returns a block of
+ * host address space that stands for a block of simulated space, page for page.  A page is copied into the block when it is first
+ * touched there, by a thread that services the host's faults through `userfaultfd`, after translating it through the same page
+ * tables, clock and backing store as `vmsim_read()`.  It is write-protected until it is written, so that its dirty bit is kept.
+ * Accesses to pages already in the block are not seen, so their reference bits are sampled instead:  whenever the clock or an
+ * idle-page scan clears one, the page is taken back out of the block, and its next access there faults to set the bit again.  Only
+ * those faults are counted as accesses and charged to the simulated clock.
+ *
+ * `vmsim_checkpoint()` saves the whole state of a simulation to a file, and `vmsim_restore()` maps it back in, so that a long
+ * warm-up need only be run once.
+ *
+ * Setting `VMSIM_HOST_PAGES` to `thp` or `hugetlb` backs real memory and the backing store with the host's huge pages (see
+ * `host.h`).  Frames are not cleared when they are freed, only when they are reused for a new page, and never-used frames are left
+ * as the host's zeros, so host memory is touched only as the workload touches it.
+ *
+ * When built with `VMSIM_64BIT` defined (as is `libvmsim64.so`), addresses and page table entries are 64 bits wide, and the page
+ * table is a radix tree of 512-entry tables.  Its depth is four levels (48-bit addresses) unless `VMSIM_PT_LEVELS` selects another
+ * depth of up to five (57-bit addresses).  Programs using that library must also be compiled with `VMSIM_64BIT` defined.
  */
 // =================================================================================================================================
 
@@ -26,8 +88,11 @@
 // =================================================================================================================================
 // INCLUDES
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 // =================================================================================================================================
 
 
@@ -35,11 +100,90 @@
 // =================================================================================================================================
 // TYPES
 
+#if defined (VMSIM_64BIT)
+
+/** A simulated or real address within `vmsim`. */
+typedef uint64_t vmsim_addr_t;
+
+/** A page table entry. */
+typedef uint64_t pt_entry_t;
+
+#else
+
 /** A simulated or real address within `vmsim`. */
 typedef uint32_t vmsim_addr_t;
 
 /** A page table entry. */
 typedef uint32_t pt_entry_t;
+
+#endif
+
+/** One operation of a batch given to `vmsim_read_batch()` or `vmsim_write_batch()`. */
+typedef struct {
+  vmsim_addr_t addr;        /**< The simulated address to read or write, whose page the operation must not extend past. */
+  size_t       size;        /**< The number of bytes to read or write. */
+  void*        buffer;      /**< The space into which to read, or from which to write. */
+} vmsim_op_t;
+
+/** Counts of the library's paging activity, since initialization or the last `vmsim_reset_stats()`. */
+typedef struct {
+  uint64_t faults;          /**< Calls to `vmsim_map_fault()` that brought in a page or page table. */
+  uint64_t evictions;       /**< Pages and page tables evicted to make room. */
+  uint64_t bs_reads;        /**< Blocks read from the backing store. */
+  uint64_t bs_writes;       /**< Blocks written to the backing store. */
+  uint64_t sim_time;        /**< Simulated nanoseconds spent on memory accesses and waiting for the backing store (see `bs.h`). */
+  uint64_t bs_fast_reads;   /**< Of the blocks read, those read from the backing store's fast tier. */
+  uint64_t promotions;      /**< Blocks moved to the fast tier. */
+  uint64_t demotions;       /**< Blocks moved back to the slow tier. */
+  uint64_t local_accesses;  /**< Accesses to frames on the accessing thread's own NUMA node. */
+  uint64_t remote_accesses; /**< Accesses to frames on other NUMA nodes. */
+  uint64_t migrations;      /**< Simulated pages migrated to the node that was using them. */
+  uint64_t thrash_episodes;  /**< Times that the page-fault frequency monitor found the simulation to have started thrashing. */
+  uint64_t thrash_accesses;  /**< Accesses made while the simulation was thrashing. */
+  uint64_t file_reads;      /**< Pages read from files mapped by `vmsim_map_file()`. */
+  uint64_t file_writes;     /**< Dirty pages written back to those files. */
+} vmsim_stats_t;
+
+/** The page-fault frequency monitor's measurements over its most recent window of accesses. */
+typedef struct {
+  bool     thrashing;       /**< Whether the simulation is thrashing. */
+  uint64_t accesses;        /**< The accesses in the window. */
+  uint64_t faults;          /**< The faults in the window that had to evict a page. */
+  uint64_t fault_rate;      /**< The faults per million accesses in the window. */
+  uint32_t worst_thread;    /**< The kernel thread ID of the thread that took the most faults in the window (0 if none did). */
+  uint64_t worst_faults;    /**< The faults that that thread took. */
+} vmsim_pff_t;
+
+/** The number of heat levels:  a page's heat is the number of the last eight idle-page scans before which it was referenced. */
+#define VMSIM_HEAT_LEVELS 9
+
+/** The activity of a block allocated by `vmsim_alloc()`, as seen by idle-page tracking. */
+typedef struct {
+  vmsim_addr_t base;                     /**< The simulated address of the block. */
+  size_t       size;                     /**< The size of the block, in bytes. */
+  uint64_t     resident;                 /**< The block's pages that are resident. */
+  uint64_t     heat[VMSIM_HEAT_LEVELS];  /**< The block's resident pages at each heat level. */
+  uint64_t     working_set;              /**< The bytes of the block's pages referenced before any of the last eight scans. */
+} vmsim_region_heat_t;
+
+/** A function to be told whenever the simulation starts or stops thrashing, given the monitor's measurements and its argument. */
+typedef void (*vmsim_thrashing_fn_t) (const vmsim_pff_t* pff, void* arg);
+
+/**
+ * The most recent translation made by a thread, kept so that the inline accessors below can reach a resident page without calling
+ * into the library.  The entry is valid only while its `epoch` matches `vmsim_tlb_epoch`, and it permits writes only if the
+ * translation that filled it was for a write, and thus already set the page's dirty bit.  While it is valid, its page is pinned
+ * between the thread's calls into the library, so that no other thread can evict it.  The accesses that it serves are counted in
+ * `hits`, which the library collects to charge them to its simulated clock.
+ */
+typedef struct {
+  vmsim_addr_t page;
+  vmsim_addr_t page_size;
+  uint8_t*     host_page;
+  uint64_t     epoch;
+  bool         writable;
+  uint64_t     hits;
+} vmsim_tlb_t;
 // =================================================================================================================================
 
 
@@ -50,6 +194,22 @@ typedef uint32_t pt_entry_t;
 #define PTE_RESIDENT_BIT   0x1
 #define PTE_REFERENCED_BIT 0x2
 #define PTE_DIRTY_BIT      0x4
+#define PTE_FILE_BIT       0x8
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// GLOBALS
+
+/** The calling thread's last translation. */
+extern __thread vmsim_tlb_t vmsim_tlb;
+
+/**
+ * Advanced by the library whenever a cached translation may have become stale, which invalidates every thread's `vmsim_tlb`.  It is
+ * atomic, so that a thread whose accesses all hit still sees another thread advance it.
+ */
+extern _Atomic uint64_t     vmsim_tlb_epoch;
 // =================================================================================================================================
 
 
@@ -74,6 +234,55 @@ void         vmsim_read       (void* buffer, vmsim_addr_t sim_addr, size_t size)
  */
 void         vmsim_write      (void* buffer, vmsim_addr_t sim_addr, size_t size); 
 
+/**
+ * \brief Perform a batch of reads from the simulated space.
+ * \param ops   The reads.
+ * \param count The number of reads.
+ *
+ * The reads are grouped by page, so that each page's translation is made once, however many reads it serves; the pages are
+ * brought in in address order before any data is copied.  Each read is still counted as an access.  The effect is the same as
+ * calling `vmsim_read()` for each read in turn.
+ */
+void         vmsim_read_batch (vmsim_op_t* ops, size_t count);
+
+/**
+ * \brief Perform a batch of writes into the simulated space.
+ * \param ops   The writes.
+ * \param count The number of writes.
+ *
+ * The writes are grouped as for `vmsim_read_batch()`.  Writes to the same addresses take effect in their order in the batch.
+ */
+void         vmsim_write_batch (vmsim_op_t* ops, size_t count);
+
+/**
+ * \brief Copy bytes from one simulated region to another, which must not overlap.
+ * \param dst  The simulated address to which to copy.
+ * \param src  The simulated address from which to copy.
+ * \param size The number of bytes to copy.
+ *
+ * The bytes are copied directly between real frames, a page at a time, with one translation of each region's page per piece.
+ */
+void         vmsim_memcpy     (vmsim_addr_t dst, vmsim_addr_t src, size_t size);
+
+/**
+ * \brief Copy bytes from one simulated region to another, which may overlap.
+ * \param dst  The simulated address to which to copy.
+ * \param src  The simulated address from which to copy.
+ * \param size The number of bytes to copy.
+ */
+void         vmsim_memmove    (vmsim_addr_t dst, vmsim_addr_t src, size_t size);
+
+/**
+ * \brief Set the bytes of a simulated region to a value.
+ * \param dst   The simulated address of the region.
+ * \param value The value.
+ * \param size  The number of bytes in the region.
+ *
+ * Each whole page set to zero is simply unmapped, releasing its frame or backing store block, so that its next access maps a
+ * fresh zero-filled page, just as its first access did; only a pinned page is zeroed in place.
+ */
+void         vmsim_memset     (vmsim_addr_t dst, uint8_t value, size_t size);
+
 /**
  * \brief Read data from the real space.
  * \param buffer A pointer to a space into which to copy data from the real space.
@@ -97,10 +306,75 @@ void         vmsim_read_real  (void* buffer, vmsim_addr_t real_addr, size_t size
 void         vmsim_write_real (void* buffer, vmsim_addr_t real_addr, size_t size);
 
 /**
- * \brief Create a new simulated-to-real mapping for a simulated address.
- * \param sim_addr The simulated address for which to create the mapping.
+ * \brief  Service a fault on a page table entry, making the page or page table to which it refers resident.
+ * \param  entry_address The real address of the page table entry that the MMU found not to be resident.
+ * \param  level         The page table level of what the entry maps:  1 for a table just below the upper one, increasing to the
+ *                       number of page table levels for a simulated page.
+ * \return the real base address of the now-resident page or page table.
+ *
+ * The entry may be empty, in which case a new zero-filled page is mapped, or may hold the backing store block of an evicted page.
+ * The table containing the entry stays resident throughout, so the MMU may resume its walk from that entry.
+ */
+vmsim_addr_t vmsim_map_fault  (vmsim_addr_t entry_address, unsigned int level);
+
+/**
+ * \brief  Pin the pages of a simulated region in real memory, and expose them to the caller.
+ * \param  sim_addr        The simulated address of the start of the region.
+ * \param  size            The number of bytes in the region.
+ * \param  write_operation Whether the caller will write into the region (which marks its pages dirty).
+ * \return a `NULL`-terminated array holding a host pointer to each page of the region, the first one pointing at `sim_addr` itself.
+ *
+ * Each page is faulted in, referenced, and then kept resident until `vmsim_unpin()` is called, so that the caller may operate on
+ * its contents in place, without copying them through `vmsim_read()` and `vmsim_write()`.  The pages are not contiguous on the
+ * host, so the array must be used one page at a time.  Pinning more pages than real memory holds is an error.
+ */
+void**       vmsim_pin        (vmsim_addr_t sim_addr, size_t size, bool write_operation);
+
+/**
+ * \brief Release pages pinned by `vmsim_pin()`, making them eligible for eviction again.
+ * \param pages The array returned by `vmsim_pin()`, which is freed.
+ */
+void         vmsim_unpin      (void** pages);
+
+/**
+ * \brief Obtain the paging activity counts.
+ * \param stats A pointer to a space into which to copy the counts.
+ */
+void         vmsim_get_stats  (vmsim_stats_t* stats);
+
+/**
+ * \brief Reset the paging activity counts to zero, and start timing the simulated runtime afresh.
+ */
+void         vmsim_reset_stats ();
+
+/**
+ * \brief Obtain the page-fault frequency monitor's measurements.
+ * \param pff A pointer to a space into which to copy the measurements.
+ */
+void         vmsim_get_pff    (vmsim_pff_t* pff);
+
+/**
+ * \brief Set the function to be told whenever the simulation starts or stops thrashing.
+ * \param fn  The function, or `NULL` for none.
+ * \param arg An argument to pass to the function.
+ *
+ * The function is called by the thread whose access crossed the threshold, once that access is complete and the library is
+ * unlocked, so it may call into the library:  to grow real memory with `vmsim_resize()`, say, or to note which thread to suspend.
+ */
+void         vmsim_on_thrashing (vmsim_thrashing_fn_t fn, void* arg);
+
+/**
+ * \brief Take a scan for idle pages now, in addition to any taken every `VMSIM_IDLE_SCAN` accesses.
+ */
+void         vmsim_scan_idle  ();
+
+/**
+ * \brief  Obtain the heatmap of the allocated blocks as of the last idle-page scan.
+ * \param  regions A pointer to a space into which to store an array of the blocks that have not been freed, in address order,
+ *                 which the caller must free.
+ * \return the number of blocks in the array.
  */
-void         vmsim_map_fault  (vmsim_addr_t sim_addr);
+uint64_t     vmsim_get_heatmap (vmsim_region_heat_t** regions);
 
 /**
  * \brief  Allocate simulated memory space.
@@ -112,8 +386,210 @@ vmsim_addr_t vmsim_alloc      (size_t size);
 /**
  * \brief Deallocate simulated memory space.
  * \param ptr The simulated address of a memory block allocated with `vmsim_alloc`.
+ *
+ * The pages lying wholly within the block are unmapped, releasing their real frames or backing store blocks.  The simulated
+ * addresses themselves are not reused.
  */
 void         vmsim_free       (vmsim_addr_t ptr);
+
+/**
+ * \brief  Map part of a host file into the simulated space.
+ * \param  path   The name of the file.
+ * \param  offset The offset within the file at which to start, a multiple of the page size.
+ * \param  len    The number of bytes to map, which may reach past the end of the file; that part reads as zeros until written.
+ * \return the simulated address of the mapping, which starts on a page boundary, or 0 if the file cannot be opened or the offset
+ *         is not aligned.
+ *
+ * The mapping is removed by passing its address to `vmsim_free()`, which writes its dirty pages back to the file first; so does
+ * unloading the library.  If the file may only be read, its pages that are written become private, and are evicted to the
+ * backing store like any others.  Neither a checkpoint nor a restore can be made while a file is mapped.
+ */
+vmsim_addr_t vmsim_map_file   (const char* path, uint64_t offset, size_t len);
+
+/**
+ * \brief  Allocate simulated memory space that is also mapped into host address space, to be used directly by native code.
+ * \param  size The number of bytes to allocate.
+ * \return a host pointer to the block, which starts on a page boundary, or `NULL` if the host does not support native mode.
+ *
+ * The block's simulated address is given by `vmsim_native_addr()`, and its pages may also be reached through `vmsim_read()` and
+ * the like, but not through `vmsim_pin()`.  Buffers given to `vmsim_read()`, `vmsim_write()` and the batch functions may lie
+ * within a native block; they are copied through a bounce buffer, since the library cannot service a fault on one while it is busy.
+ */
+void*        vmsim_native_alloc (size_t size);
+
+/**
+ * \brief Deallocate a block allocated with `vmsim_native_alloc()`, releasing both its simulated pages and its host address space.
+ * \param ptr The host pointer to the block.
+ */
+void         vmsim_native_free (void* ptr);
+
+/**
+ * \brief  Find the simulated address that a host address within a block from `vmsim_native_alloc()` stands for.
+ * \param  ptr The host address.
+ * \return the simulated address, or 0 if the host address lies in no such block.
+ */
+vmsim_addr_t vmsim_native_addr (const void* ptr);
+
+/**
+ * \brief  Change the size of real memory while the simulation runs, as a balloon driver would.
+ * \param  size The new size, in bytes, which may not exceed `VMSIM_REAL_MEM_MAX`.
+ * \return whether real memory was resized; it is not if the size is out of range, or if shrinking would remove a pinned frame.
+ *
+ * Real memory grows and shrinks at its top.  Growing adds never-used frames, and leaves every page where it is.  Shrinking evicts
+ * pages chosen by the clock until the pages that remain fit, and moves those in the frames being removed to frames that stay.  The
+ * page tables must still fit, or the library aborts, as it does whenever nothing can be evicted.
+ */
+bool         vmsim_resize     (size_t size);
+
+/**
+ * \brief  Save the whole state of the simulation to a file.
+ * \param  path The name of the file, which is replaced only once the checkpoint is complete.
+ * \return whether the checkpoint was written successfully; it is not while a file is mapped by `vmsim_map_file()`.
+ *
+ * The checkpoint holds real memory (page tables included), the frame table, the clock hand, the backing store blocks in use, the
+ * allocators' state, the simulated clock and the activity counts.  It does not hold pins, nor the reference record or trace.
+ */
+bool         vmsim_checkpoint (const char* path);
+
+/**
+ * \brief  Return the simulation to the state saved in a checkpoint, discarding the current one.
+ * \param  path The name of a file written by `vmsim_checkpoint()`.
+ * \return whether the checkpoint was restored; if it cannot be read, or was taken with another geometry, real memory size, NUMA
+ *         layout or backing store configuration, or if a file is mapped or real memory or the backing store came from the host's
+ *         pool of huge pages (see `host.h`), nothing is changed.
+ *
+ * Real memory and the backing store blocks are mapped from the file rather than read from it, so restoring takes time in
+ * proportion to the frame table, and each page is read when it is first touched.  Pages are restored unpinned, and any array
+ * returned by `vmsim_pin()` beforehand must no longer be used.  The devices and the policies that are not part of the geometry
+ * (`VMSIM_PAGEABLE_PT` say) are this run's own, so one warmed-up checkpoint can serve runs that vary them.
+ */
+bool         vmsim_restore    (const char* path);
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// INLINE ACCESSORS
+//
+// Typed loads and stores that go straight to the real space when the calling thread's last translation covers the access, and that
+// otherwise fall back on `vmsim_read()` or `vmsim_write()`, which translate the address, service any fault, and refill the cached
+// translation.  An access must not straddle a page boundary.
+//
+// The library serializes its calls with a lock, so several threads may use it at once.  Once a second thread has called into the
+// library, translations are no longer cached, and these accessors always take the locked path.
+
+/**
+ * \brief  Determine whether the calling thread's last translation covers an access.
+ * \param  sim_addr        The simulated address of the access.
+ * \param  size            The number of bytes accessed.
+ * \param  write_operation Whether the access is a write.
+ * \return whether the access may use `vmsim_tlb.host_page` directly, in which case it is counted as a hit.
+ */
+static inline bool vmsim_tlb_hit (vmsim_addr_t sim_addr, size_t size, bool write_operation) {
+
+  bool hit = ((vmsim_tlb.epoch == atomic_load_explicit(&vmsim_tlb_epoch, memory_order_acquire)) &&
+              ((vmsim_addr_t) (sim_addr - vmsim_tlb.page) <= vmsim_tlb.page_size - size) &&
+              (vmsim_tlb.writable || !write_operation));
+  vmsim_tlb.hits += hit;
+  return hit;
+
+} // vmsim_tlb_hit ()
+
+/**
+ * \brief  Read one byte from the simulated space.
+ * \param  sim_addr The simulated address from which to read.
+ * \return the value read.
+ */
+static inline uint8_t vmsim_load_u8 (vmsim_addr_t sim_addr) {
+
+  uint8_t value;
+  if (vmsim_tlb_hit(sim_addr, sizeof(value), false)) {
+    value = vmsim_tlb.host_page[sim_addr - vmsim_tlb.page];
+  } else {
+    vmsim_read(&value, sim_addr, sizeof(value));
+  }
+  return value;
+
+} // vmsim_load_u8 ()
+
+/**
+ * \brief  Read a 32-bit integer from the simulated space.
+ * \param  sim_addr The simulated address from which to read.
+ * \return the value read.
+ */
+static inline uint32_t vmsim_load_u32 (vmsim_addr_t sim_addr) {
+
+  uint32_t value;
+  if (vmsim_tlb_hit(sim_addr, sizeof(value), false)) {
+    memcpy(&value, vmsim_tlb.host_page + (sim_addr - vmsim_tlb.page), sizeof(value));
+  } else {
+    vmsim_read(&value, sim_addr, sizeof(value));
+  }
+  return value;
+
+} // vmsim_load_u32 ()
+
+/**
+ * \brief  Read a 64-bit integer from the simulated space.
+ * \param  sim_addr The simulated address from which to read.
+ * \return the value read.
+ */
+static inline uint64_t vmsim_load_u64 (vmsim_addr_t sim_addr) {
+
+  uint64_t value;
+  if (vmsim_tlb_hit(sim_addr, sizeof(value), false)) {
+    memcpy(&value, vmsim_tlb.host_page + (sim_addr - vmsim_tlb.page), sizeof(value));
+  } else {
+    vmsim_read(&value, sim_addr, sizeof(value));
+  }
+  return value;
+
+} // vmsim_load_u64 ()
+
+/**
+ * \brief Write one byte into the simulated space.
+ * \param sim_addr The simulated address into which to write.
+ * \param value    The value to write.
+ */
+static inline void vmsim_store_u8 (vmsim_addr_t sim_addr, uint8_t value) {
+
+  if (vmsim_tlb_hit(sim_addr, sizeof(value), true)) {
+    vmsim_tlb.host_page[sim_addr - vmsim_tlb.page] = value;
+  } else {
+    vmsim_write(&value, sim_addr, sizeof(value));
+  }
+
+} // vmsim_store_u8 ()
+
+/**
+ * \brief Write a 32-bit integer into the simulated space.
+ * \param sim_addr The simulated address into which to write.
+ * \param value    The value to write.
+ */
+static inline void vmsim_store_u32 (vmsim_addr_t sim_addr, uint32_t value) {
+
+  if (vmsim_tlb_hit(sim_addr, sizeof(value), true)) {
+    memcpy(vmsim_tlb.host_page + (sim_addr - vmsim_tlb.page), &value, sizeof(value));
+  } else {
+    vmsim_write(&value, sim_addr, sizeof(value));
+  }
+
+} // vmsim_store_u32 ()
+
+/**
+ * \brief Write a 64-bit integer into the simulated space.
+ * \param sim_addr The simulated address into which to write.
+ * \param value    The value to write.
+ */
+static inline void vmsim_store_u64 (vmsim_addr_t sim_addr, uint64_t value) {
+
+  if (vmsim_tlb_hit(sim_addr, sizeof(value), true)) {
+    memcpy(vmsim_tlb.host_page + (sim_addr - vmsim_tlb.page), &value, sizeof(value));
+  } else {
+    vmsim_write(&value, sim_addr, sizeof(value));
+  }
+
+} // vmsim_store_u64 ()
 // =================================================================================================================================
 
 
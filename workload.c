@@ -0,0 +1,489 @@
+// =================================================================================================================================
+/**
+ * workload.c
+ *
+ * Generate reproducible synthetic access streams, and drive the `vmsim` library with them.
+ **/
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// INCLUDES
+
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vmsim.h"
+#include "workload.h"
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// CONSTANTS AND MACRO FUNCTIONS
+
+#define WORD_SIZE             sizeof(uint64_t)
+#define ALIGN_WORD(offset)    ((offset) & ~(uint64_t) (WORD_SIZE - 1))
+
+// The names of the kinds, in the order of `workload_kind_t`.
+static const char* kind_names[] = {
+  "sequential", "strided", "uniform", "zipf", "loop", "hotcold", "phased", "chase"
+};
+#define NUM_KINDS (sizeof(kind_names) / sizeof(kind_names[0]))
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// TYPES
+
+/** The constants of the rejection-inversion Zipf sampler, which depend only on the number of items and the skew. */
+typedef struct {
+  double   skew;
+  uint64_t items;
+  double   h_integral_x1;
+  double   h_integral_items;
+  double   s;
+} zipf_t;
+
+struct workload_stream {
+  workload_spec_t spec;
+  uint64_t        items;        // The number of items in the data set.
+  uint64_t        count;        // The number of accesses produced so far.
+  uint64_t        rng;          // The state of the random number generator.
+  uint64_t        position;     // The current offset, for the kinds that move from one access to the next.
+  uint64_t        phase_base;   // For `WORKLOAD_PHASED`, the offset of the current working set.
+  uint64_t*       next_item;    // For `WORKLOAD_POINTER_CHASE`, the item that follows each item on the cycle.
+  zipf_t          zipf;
+};
+
+/** The work of one thread of `workload_drive()`. */
+typedef struct {
+  const workload_spec_t* spec;
+  vmsim_addr_t           base;
+  uint64_t               accesses;
+  unsigned int           stream_id;
+  uint64_t               checksum;
+} driver_t;
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief  Generate a pseudo-random number with a _xorshift64*_ generator.
+ * \param  stream The stream whose generator to advance.
+ * \return the next pseudo-random number.
+ */
+static uint64_t next_random (workload_stream_t* stream) {
+
+  stream->rng ^= stream->rng >> 12;
+  stream->rng ^= stream->rng << 25;
+  stream->rng ^= stream->rng >> 27;
+  return stream->rng * 0x2545f4914f6cdd1dULL;
+
+} // next_random ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief  Generate a pseudo-random number uniformly distributed in [0, 1).
+ * \param  stream The stream whose generator to advance.
+ * \return the next pseudo-random number.
+ */
+static double next_unit (workload_stream_t* stream) {
+
+  return (next_random(stream) >> 11) * (1.0 / 9007199254740992.0);
+
+} // next_unit ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief  Derive a well-mixed generator state from a seed and a stream number (the _splitmix64_ finalizer).
+ * \param  seed      The workload's seed.
+ * \param  stream_id The stream number.
+ * \return a non-zero generator state.
+ */
+static uint64_t mix_seed (uint64_t seed, unsigned int stream_id) {
+
+  uint64_t z = seed + ((uint64_t) (stream_id + 1) * 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z = z ^ (z >> 31);
+  return (z == 0) ? 1 : z;
+
+} // mix_seed ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// ZIPF SAMPLING
+//
+// Rejection-inversion sampling (Hörmann and Derflinger, 1996), which draws a rank from 1 to n with probability proportional to
+// rank^-skew in expected constant time, without a table of the distribution.  The helpers are numerically stable forms of
+// log1p(x)/x and expm1(x)/x.
+
+static double zipf_helper1 (double x) {
+
+  return (fabs(x) > 1e-8) ? log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+
+}
+
+static double zipf_helper2 (double x) {
+
+  return (fabs(x) > 1e-8) ? expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+
+}
+
+static double zipf_h (const zipf_t* zipf, double x) {
+
+  return exp(-zipf->skew * log(x));
+
+}
+
+static double zipf_h_integral (const zipf_t* zipf, double x) {
+
+  double log_x = log(x);
+  return zipf_helper2((1.0 - zipf->skew) * log_x) * log_x;
+
+}
+
+static double zipf_h_integral_inverse (const zipf_t* zipf, double x) {
+
+  double t = x * (1.0 - zipf->skew);
+  if (t < -1.0) {
+    t = -1.0;
+  }
+  return exp(zipf_helper1(t) * x);
+
+}
+
+static void zipf_init (zipf_t* zipf, uint64_t items, double skew) {
+
+  zipf->skew             = skew;
+  zipf->items            = items;
+  zipf->h_integral_x1    = zipf_h_integral(zipf, 1.5) - 1.0;
+  zipf->h_integral_items = zipf_h_integral(zipf, items + 0.5);
+  zipf->s                = 2.0 - zipf_h_integral_inverse(zipf, zipf_h_integral(zipf, 2.5) - zipf_h(zipf, 2.0));
+
+}
+
+static uint64_t zipf_sample (workload_stream_t* stream) {
+
+  const zipf_t* zipf = &stream->zipf;
+  while (true) {
+    double u = zipf->h_integral_items + next_unit(stream) * (zipf->h_integral_x1 - zipf->h_integral_items);
+    double x = zipf_h_integral_inverse(zipf, u);
+    double k = floor(x + 0.5);
+    if (k < 1.0) {
+      k = 1.0;
+    } else if (k > zipf->items) {
+      k = zipf->items;
+    }
+    if ((k - x <= zipf->s) || (u >= zipf_h_integral(zipf, k + 0.5) - zipf_h(zipf, k))) {
+      return (uint64_t) k;
+    }
+  }
+
+}
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void workload_default_spec (workload_spec_t* spec, workload_kind_t kind, uint64_t size) {
+
+  spec->kind           = kind;
+  spec->size           = size;
+  spec->item_size      = 4096;
+  spec->stride         = 4096 + 64;
+  spec->zipf_skew      = 0.99;
+  spec->hot_fraction   = 0.1;
+  spec->hot_accesses   = 0.9;
+  spec->working_set    = size / 8;
+  spec->phase_length   = 100000;
+  spec->write_fraction = 0.25;
+  spec->seed           = 0x2545f4914f6cdd1dULL;
+
+} // workload_default_spec ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+bool workload_parse_kind (const char* name, workload_kind_t* kind) {
+
+  for (int i = 0; i < NUM_KINDS; i += 1) {
+    if (strcmp(name, kind_names[i]) == 0) {
+      *kind = (workload_kind_t) i;
+      return true;
+    }
+  }
+  return false;
+
+} // workload_parse_kind ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+const char* workload_kind_name (workload_kind_t kind) {
+
+  assert(kind < NUM_KINDS);
+  return kind_names[kind];
+
+} // workload_kind_name ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+workload_stream_t* workload_open (const workload_spec_t* spec, unsigned int stream_id) {
+
+  workload_stream_t* stream = calloc(1, sizeof(workload_stream_t));
+  assert(stream != NULL);
+  stream->spec  = *spec;
+  stream->items = spec->size / spec->item_size;
+  stream->rng   = mix_seed(spec->seed, stream_id);
+  assert(spec->size >= WORD_SIZE && stream->items > 0);
+
+  // Threads running the sequential kinds start at different places, so that they do not march in lockstep.
+  if (stream_id > 0 && (spec->kind == WORKLOAD_SEQUENTIAL || spec->kind == WORKLOAD_STRIDED || spec->kind == WORKLOAD_LOOP)) {
+    stream->position = ALIGN_WORD(next_random(stream) % spec->size);
+  }
+
+  switch (spec->kind) {
+
+  case WORKLOAD_ZIPF:
+    zipf_init(&stream->zipf, stream->items, spec->zipf_skew);
+    break;
+
+  case WORKLOAD_HOTCOLD:
+    // The cold region must not be empty, since the accesses that miss the hot one go there.
+    assert(spec->hot_fraction >= 0.0 && spec->hot_fraction < 1.0 && spec->hot_accesses >= 0.0 && spec->hot_accesses <= 1.0 &&
+           (uint64_t) (spec->size * spec->hot_fraction) < spec->size);
+    break;
+
+  case WORKLOAD_PHASED:
+    assert(spec->working_set >= WORD_SIZE && spec->working_set <= spec->size && spec->phase_length > 0);
+    stream->phase_base = ALIGN_WORD(next_random(stream) % (spec->size - spec->working_set + 1));
+    break;
+
+  case WORKLOAD_POINTER_CHASE:
+    // Sattolo's algorithm yields a random permutation that is a single cycle, so the chase visits every item.
+    stream->next_item = malloc(stream->items * sizeof(uint64_t));
+    assert(stream->next_item != NULL);
+    uint64_t* order = malloc(stream->items * sizeof(uint64_t));
+    assert(order != NULL);
+    for (uint64_t i = 0; i < stream->items; i += 1) {
+      order[i] = i;
+    }
+    for (uint64_t i = stream->items - 1; i > 0; i -= 1) {
+      uint64_t j   = next_random(stream) % i;
+      uint64_t tmp = order[i];
+      order[i] = order[j];
+      order[j] = tmp;
+    }
+    for (uint64_t i = 0; i < stream->items; i += 1) {
+      stream->next_item[order[i]] = order[(i + 1) % stream->items];
+    }
+    free(order);
+    break;
+
+  default:
+    break;
+
+  }
+
+  return stream;
+
+} // workload_open ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void workload_next (workload_stream_t* stream, workload_access_t* access) {
+
+  const workload_spec_t* spec = &stream->spec;
+  uint64_t               offset;
+
+  switch (spec->kind) {
+
+  case WORKLOAD_SEQUENTIAL:
+    offset = stream->position;
+    stream->position = (stream->position + WORD_SIZE) % spec->size;
+    break;
+
+  case WORKLOAD_STRIDED:
+    offset = stream->position;
+    stream->position = (stream->position + spec->stride) % spec->size;
+    break;
+
+  case WORKLOAD_UNIFORM:
+    offset = next_random(stream) % spec->size;
+    break;
+
+  case WORKLOAD_ZIPF:
+    offset = ((zipf_sample(stream) - 1) * spec->item_size) + (next_random(stream) % spec->item_size);
+    break;
+
+  case WORKLOAD_LOOP:
+    offset = (stream->position / spec->item_size) * spec->item_size;
+    stream->position = (offset + spec->item_size) % (stream->items * spec->item_size);
+    break;
+
+  case WORKLOAD_HOTCOLD: {
+    uint64_t hot_size = (uint64_t) (spec->size * spec->hot_fraction);
+    if (hot_size > 0 && next_unit(stream) < spec->hot_accesses) {
+      offset = next_random(stream) % hot_size;
+    } else {
+      offset = hot_size + (next_random(stream) % (spec->size - hot_size));
+    }
+    break;
+  }
+
+  case WORKLOAD_PHASED:
+    if (stream->count > 0 && stream->count % spec->phase_length == 0) {
+      stream->phase_base = next_random(stream) % (spec->size - spec->working_set + 1);
+    }
+    offset = stream->phase_base + (next_random(stream) % spec->working_set);
+    break;
+
+  case WORKLOAD_POINTER_CHASE:
+    offset = stream->position * spec->item_size;
+    stream->position = stream->next_item[stream->position];
+    break;
+
+  default:
+    assert(false);
+    offset = 0;
+
+  }
+
+  stream->count += 1;
+  access->offset = ALIGN_WORD(offset);
+  if (access->offset + WORD_SIZE > spec->size) {
+    access->offset = ALIGN_WORD(spec->size - WORD_SIZE);
+  }
+  access->write  = (spec->kind != WORKLOAD_POINTER_CHASE) && (next_unit(stream) < spec->write_fraction);
+
+} // workload_next ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+void workload_close (workload_stream_t* stream) {
+
+  free(stream->next_item);
+  free(stream);
+
+} // workload_close ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+/**
+ * \brief  Run one thread's stream against the simulated data set.
+ * \param  arg The thread's `driver_t`.
+ * \return `NULL`.
+ */
+static void* drive_stream (void* arg) {
+
+  driver_t*          driver   = (driver_t*) arg;
+  workload_stream_t* stream   = workload_open(driver->spec, driver->stream_id);
+  uint64_t           checksum = 0;
+
+  if (driver->spec->kind == WORKLOAD_POINTER_CHASE) {
+
+    // Follow the pointers stored in the data set, each load deciding the next address.
+    uint64_t offset = (stream->next_item[0] * driver->spec->item_size);
+    for (uint64_t i = 0; i < driver->accesses; i += 1) {
+      offset = vmsim_load_u64(driver->base + offset);
+      checksum += offset;
+    }
+
+  } else {
+
+    workload_access_t access;
+    for (uint64_t i = 0; i < driver->accesses; i += 1) {
+      workload_next(stream, &access);
+      if (access.write) {
+        vmsim_store_u64(driver->base + access.offset, i);
+      } else {
+        checksum += vmsim_load_u64(driver->base + access.offset);
+      }
+    }
+
+  }
+
+  workload_close(stream);
+  driver->checksum = checksum;
+  return NULL;
+
+} // drive_stream ()
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+uint64_t workload_drive (const workload_spec_t* spec, vmsim_addr_t base, uint64_t accesses, unsigned int threads) {
+
+  assert(threads > 0);
+
+  // Link the data set into the cycle of stream 0, which every thread then follows from its own starting point.
+  if (spec->kind == WORKLOAD_POINTER_CHASE) {
+    workload_stream_t* stream = workload_open(spec, 0);
+    for (uint64_t item = 0; item < stream->items; item += 1) {
+      vmsim_store_u64(base + (item * spec->item_size), stream->next_item[item] * spec->item_size);
+    }
+    workload_close(stream);
+  }
+
+  driver_t* drivers = calloc(threads, sizeof(driver_t));
+  assert(drivers != NULL);
+  for (unsigned int i = 0; i < threads; i += 1) {
+    drivers[i].spec      = spec;
+    drivers[i].base      = base;
+    drivers[i].accesses  = accesses;
+    drivers[i].stream_id = i;
+  }
+
+  // A single thread runs in the caller, so that it keeps its cached translations.
+  uint64_t checksum = 0;
+  if (threads == 1) {
+    drive_stream(&drivers[0]);
+  } else {
+    pthread_t* ids = calloc(threads, sizeof(pthread_t));
+    assert(ids != NULL);
+    for (unsigned int i = 0; i < threads; i += 1) {
+      int result = pthread_create(&ids[i], NULL, drive_stream, &drivers[i]);
+      assert(result == 0);
+    }
+    for (unsigned int i = 0; i < threads; i += 1) {
+      pthread_join(ids[i], NULL);
+    }
+    free(ids);
+  }
+  for (unsigned int i = 0; i < threads; i += 1) {
+    checksum += drivers[i].checksum;
+  }
+
+  free(drivers);
+  return checksum;
+
+} // workload_drive ()
+// =================================================================================================================================
@@ -0,0 +1,148 @@
+// =================================================================================================================================
+/**
+ * \file   workload.h
+ * \brief  The interface for the `workload` library of synthetic access streams for `vmsim`.
+ *
+ * A _workload_ describes a pattern of accesses over a simulated data set:  which offsets within the data set are touched, in what
+ * order, and which touches are writes.  A _stream_ is one seeded instance of a workload.  Streams with the same specification and
+ * stream number always produce the same accesses, so experiments are reproducible, while streams with different numbers (say, one
+ * per thread) are independent.  `workload_drive()` runs streams against the `vmsim` library from any number of threads.
+ */
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_WORKLOAD_H)
+#define _WORKLOAD_H
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// INCLUDES
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "vmsim.h"
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// TYPES
+
+/** The kinds of access pattern. */
+typedef enum {
+  WORKLOAD_SEQUENTIAL,     /**< Word by word through the data set, wrapping around. */
+  WORKLOAD_STRIDED,        /**< Every `stride` bytes through the data set, wrapping around. */
+  WORKLOAD_UNIFORM,        /**< Words chosen uniformly at random. */
+  WORKLOAD_ZIPF,           /**< Items chosen with Zipfian popularity of skew `zipf_skew`, the first item being the most popular. */
+  WORKLOAD_LOOP,           /**< One word of each item in turn, looping over the data set. */
+  WORKLOAD_HOTCOLD,        /**< A `hot_accesses` share of accesses to the first `hot_fraction` of the data set, the rest elsewhere. */
+  WORKLOAD_PHASED,         /**< Uniform accesses within a working set of `working_set` bytes that moves every `phase_length`. */
+  WORKLOAD_POINTER_CHASE   /**< Items visited along a random cycle, each access depending on the value loaded by the previous. */
+} workload_kind_t;
+
+/** The specification of a workload.  Fields that do not apply to its kind are ignored. */
+typedef struct {
+  workload_kind_t kind;
+  uint64_t        size;            /**< The number of bytes in the data set. */
+  uint64_t        item_size;       /**< The granularity of the item-oriented kinds, in bytes. */
+  uint64_t        stride;          /**< For `WORKLOAD_STRIDED`, the distance between accesses, in bytes. */
+  double          zipf_skew;       /**< For `WORKLOAD_ZIPF`, the exponent of the distribution. */
+  double          hot_fraction;    /**< For `WORKLOAD_HOTCOLD`, the fraction of the data set that is hot, less than 1. */
+  double          hot_accesses;    /**< For `WORKLOAD_HOTCOLD`, the fraction of accesses that go to the hot region. */
+  uint64_t        working_set;     /**< For `WORKLOAD_PHASED`, the number of bytes in each phase's working set. */
+  uint64_t        phase_length;    /**< For `WORKLOAD_PHASED`, the number of accesses in each phase. */
+  double          write_fraction;  /**< The fraction of accesses that are writes. */
+  uint64_t        seed;            /**< The seed from which every stream's generator is derived. */
+} workload_spec_t;
+
+/** One access generated by a stream. */
+typedef struct {
+  uint64_t offset;                 /**< The offset of the accessed word within the data set, always 8-byte aligned. */
+  bool     write;                  /**< Whether the access is a write. */
+} workload_access_t;
+
+/** A stream of accesses, opaque to its users. */
+typedef struct workload_stream workload_stream_t;
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+// FUNCTIONS
+
+/**
+ * \brief Fill in a specification with the defaults for a kind of workload:  4 KB items, a stride of just over a page, a Zipfian
+ *        skew of 0.99, 90% of accesses to the hottest 10%, phases of 100,000 accesses over an eighth of the data set, and one
+ *        write in four.
+ * \param spec The specification to fill in.
+ * \param kind The kind of workload.
+ * \param size The number of bytes in the data set.
+ */
+void               workload_default_spec (workload_spec_t* spec, workload_kind_t kind, uint64_t size);
+
+/**
+ * \brief  Find a kind of workload by name.
+ * \param  name The name of the kind, such as `"zipf"`.
+ * \param  kind A pointer to a space into which to store the kind.
+ * \return whether the name was recognized.
+ */
+bool               workload_parse_kind   (const char* name, workload_kind_t* kind);
+
+/**
+ * \brief  Name a kind of workload.
+ * \param  kind The kind.
+ * \return the name of the kind.
+ */
+const char*        workload_kind_name    (workload_kind_t kind);
+
+/**
+ * \brief  Create a stream of accesses.
+ * \param  spec      The specification of the workload, which is copied.
+ * \param  stream_id The number of this stream, which selects its own independent sequence of random choices.
+ * \return the new stream.
+ *
+ * Preparing a stream takes time and space proportional to the number of items only for `WORKLOAD_POINTER_CHASE`; every kind then
+ * produces each access in constant time.
+ */
+workload_stream_t* workload_open         (const workload_spec_t* spec, unsigned int stream_id);
+
+/**
+ * \brief Produce the next access of a stream.
+ * \param stream The stream.
+ * \param access A pointer to a space into which to store the access.
+ *
+ * For `WORKLOAD_POINTER_CHASE`, the offset produced is where the previous access's pointer leads; `workload_drive()` follows the
+ * pointers actually stored in the simulated data set instead.
+ */
+void               workload_next         (workload_stream_t* stream, workload_access_t* access);
+
+/**
+ * \brief Destroy a stream.
+ * \param stream The stream.
+ */
+void               workload_close        (workload_stream_t* stream);
+
+/**
+ * \brief  Run a workload against a simulated data set with `vmsim_load_u64()` and `vmsim_store_u64()`.
+ * \param  spec     The specification of the workload.
+ * \param  base     The simulated address of the data set, which must be at least `spec->size` bytes long.
+ * \param  accesses The number of accesses to make in each thread.
+ * \param  threads  The number of threads to run, each with its own stream (numbered from 0).
+ * \return a checksum of the values loaded.
+ *
+ * For `WORKLOAD_POINTER_CHASE`, the data set is first linked into a cycle, each item's first word holding the offset of the next.
+ */
+uint64_t           workload_drive        (const workload_spec_t* spec, vmsim_addr_t base, uint64_t accesses, unsigned int threads);
+// =================================================================================================================================
+
+
+
+// =================================================================================================================================
+#endif // _WORKLOAD_H
+// =================================================================================================================================